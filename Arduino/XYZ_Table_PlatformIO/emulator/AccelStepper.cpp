@@ -0,0 +1,195 @@
+/**
+ * ===============================================================
+ *  AccelStepper.cpp (emulator)
+ *  XYZ Camera Positioning System - Simulated Stepper Driver
+ * ===============================================================
+ */
+
+#include "AccelStepper.h"
+
+AccelStepper::AccelStepper(uint8_t interface, uint8_t pin1, uint8_t pin2,
+                           uint8_t pin3, uint8_t pin4, bool enable)
+	: _direction(DIRECTION_CCW), _stepPin(pin1), _dirPin(pin2),
+	  _dirInverted(false), _stepInverted(false), _currentPos(0), _targetPos(0),
+	  _speed(0.0f), _maxSpeed(1.0f), _acceleration(0.0f), _stepInterval(0),
+	  _lastStepTime(0), _n(0), _c0(0.0f), _cn(0.0f), _cmin(1.0f)
+{
+	pinMode(_stepPin, OUTPUT);
+	pinMode(_dirPin, OUTPUT);
+	setAcceleration(1);
+}
+
+void AccelStepper::moveTo(long absolute)
+{
+	if (_targetPos != absolute) {
+		_targetPos = absolute;
+		computeNewSpeed();
+	}
+}
+
+void AccelStepper::move(long relative)
+{
+	moveTo(_currentPos + relative);
+}
+
+boolean AccelStepper::runSpeed()
+{
+	if (!_stepInterval)
+		return false;
+
+	unsigned long time = micros();
+	if (time - _lastStepTime >= _stepInterval) {
+		if (_direction == DIRECTION_CW)
+			_currentPos += 1;
+		else
+			_currentPos -= 1;
+		step(_currentPos);
+		_lastStepTime = time;
+		return true;
+	}
+	return false;
+}
+
+long AccelStepper::distanceToGo()    { return _targetPos - _currentPos; }
+long AccelStepper::targetPosition()  { return _targetPos; }
+long AccelStepper::currentPosition() { return _currentPos; }
+
+void AccelStepper::setCurrentPosition(long position)
+{
+	_targetPos = _currentPos = position;
+	_n            = 0;
+	_stepInterval = 0;
+	_speed        = 0.0f;
+}
+
+void AccelStepper::computeNewSpeed()
+{
+	long distanceTo  = distanceToGo();
+	long stepsToStop = (long)((_speed * _speed) / (2.0f * _acceleration));
+
+	if (distanceTo == 0 && stepsToStop <= 1) {
+		_stepInterval = 0;
+		_speed        = 0.0f;
+		_n            = 0;
+		return;
+	}
+
+	if (distanceTo > 0) {
+		if (_n > 0) {
+			if ((stepsToStop >= distanceTo) || _direction == DIRECTION_CCW)
+				_n = -stepsToStop;   // start decelerating
+		} else if (_n < 0) {
+			if ((stepsToStop < distanceTo) && _direction == DIRECTION_CW)
+				_n = -_n;            // start accelerating
+		}
+	} else if (distanceTo < 0) {
+		if (_n > 0) {
+			if ((stepsToStop >= -distanceTo) || _direction == DIRECTION_CW)
+				_n = -stepsToStop;
+		} else if (_n < 0) {
+			if ((stepsToStop < -distanceTo) && _direction == DIRECTION_CCW)
+				_n = -_n;
+		}
+	}
+
+	if (_n == 0) {
+		_cn        = _c0;
+		_direction = (distanceTo > 0) ? DIRECTION_CW : DIRECTION_CCW;
+	} else {
+		_cn = _cn - ((2.0f * _cn) / ((4.0f * _n) + 1));
+		_cn = max(_cn, _cmin);
+	}
+	_n++;
+	_stepInterval = _cn;
+	_speed        = 1000000.0f / _cn;
+	if (_direction == DIRECTION_CCW)
+		_speed = -_speed;
+}
+
+boolean AccelStepper::run()
+{
+	if (runSpeed())
+		computeNewSpeed();
+	return _speed != 0.0f || distanceToGo() != 0;
+}
+
+void AccelStepper::setMaxSpeed(float speed)
+{
+	if (speed < 0.0f)
+		speed = -speed;
+	if (_maxSpeed != speed) {
+		_maxSpeed = speed;
+		_cmin     = 1000000.0f / speed;
+		if (_n > 0) {
+			_n = (long)((_speed * _speed) / (2.0f * _acceleration));
+			computeNewSpeed();
+		}
+	}
+}
+
+float AccelStepper::maxSpeed() { return _maxSpeed; }
+
+void AccelStepper::setAcceleration(float acceleration)
+{
+	if (acceleration == 0.0f)
+		return;
+	if (acceleration < 0.0f)
+		acceleration = -acceleration;
+	if (_acceleration != acceleration) {
+		_n            = _n * (_acceleration / acceleration);
+		_c0           = 0.676f * sqrtf(2.0f / acceleration) * 1000000.0f;
+		_acceleration = acceleration;
+		computeNewSpeed();
+	}
+}
+
+float AccelStepper::acceleration() { return _acceleration; }
+
+void AccelStepper::setSpeed(float speed)
+{
+	if (speed == _speed)
+		return;
+	speed = constrain(speed, -_maxSpeed, _maxSpeed);
+	if (speed == 0.0f) {
+		_stepInterval = 0;
+	} else {
+		_stepInterval = fabsf(1000000.0f / speed);
+		_direction    = (speed > 0.0f) ? DIRECTION_CW : DIRECTION_CCW;
+	}
+	_speed = speed;
+}
+
+float AccelStepper::speed() { return _speed; }
+
+void AccelStepper::stop()
+{
+	if (_speed != 0.0f) {
+		long stepsToStop = (long)((_speed * _speed) / (2.0f * _acceleration)) + 1;
+		if (_speed > 0)
+			move(stepsToStop);
+		else
+			move(-stepsToStop);
+	}
+}
+
+bool AccelStepper::isRunning()
+{
+	return !(_speed == 0.0f && _targetPos == _currentPos);
+}
+
+void AccelStepper::setMinPulseWidth(unsigned int minWidth) {}
+
+void AccelStepper::setPinsInverted(bool directionInvert, bool stepInvert, bool enableInvert)
+{
+	_dirInverted  = directionInvert;
+	_stepInverted = stepInvert;
+}
+
+// DRIVER interface: set DIR, then one STEP pulse.
+void AccelStepper::step(long step)
+{
+	bool forward = (_direction == DIRECTION_CW);
+	digitalWrite(_dirPin, (forward ^ _dirInverted) ? HIGH : LOW);
+	digitalWrite(_stepPin, _stepInverted ? LOW : HIGH);
+	digitalWrite(_stepPin, _stepInverted ? HIGH : LOW);
+}
@@ -0,0 +1,86 @@
+/**
+ * ===============================================================
+ *  AccelStepper.h (emulator)
+ *  XYZ Camera Positioning System - Simulated Stepper Driver
+ * ===============================================================
+ *  Description:
+ *  - Same public/protected interface as the AccelStepper library,
+ *    with the same constant-acceleration step timing (David Austin's
+ *    approximation), driving the emulated STEP/DIR pins.
+ *  - Only the DRIVER interface is simulated; that is all the
+ *    firmware uses.
+ * ===============================================================
+ */
+
+#ifndef EMULATOR_ACCELSTEPPER_H_
+#define EMULATOR_ACCELSTEPPER_H_
+
+#include <Arduino.h>
+
+class AccelStepper {
+public:
+	typedef enum {
+		FUNCTION  = 0,
+		DRIVER    = 1,
+		FULL2WIRE = 2,
+		FULL3WIRE = 3,
+		FULL4WIRE = 4,
+		HALF3WIRE = 6,
+		HALF4WIRE = 8
+	} MotorInterfaceType;
+
+	AccelStepper(uint8_t interface = AccelStepper::FULL4WIRE, uint8_t pin1 = 2, uint8_t pin2 = 3,
+	             uint8_t pin3 = 4, uint8_t pin4 = 5, bool enable = true);
+	virtual ~AccelStepper() {}
+
+	void    moveTo(long absolute);
+	void    move(long relative);
+	boolean run();
+	boolean runSpeed();
+	void    setMaxSpeed(float speed);
+	float   maxSpeed();
+	void    setAcceleration(float acceleration);
+	float   acceleration();
+	void    setSpeed(float speed);
+	float   speed();
+	long    distanceToGo();
+	long    targetPosition();
+	long    currentPosition();
+	void    setCurrentPosition(long position);
+	void    stop();
+	bool    isRunning();
+	void    setMinPulseWidth(unsigned int minWidth);
+	void    setPinsInverted(bool directionInvert = false, bool stepInvert = false, bool enableInvert = false);
+	virtual void enableOutputs() {}
+	virtual void disableOutputs() {}
+
+protected:
+	typedef enum {
+		DIRECTION_CCW = 0,
+		DIRECTION_CW  = 1
+	} Direction;
+
+	void         computeNewSpeed();
+	virtual void step(long step);
+
+	boolean _direction;
+
+private:
+	uint8_t       _stepPin;
+	uint8_t       _dirPin;
+	bool          _dirInverted;
+	bool          _stepInverted;
+	long          _currentPos;
+	long          _targetPos;
+	float         _speed;
+	float         _maxSpeed;
+	float         _acceleration;
+	unsigned long _stepInterval;
+	unsigned long _lastStepTime;
+	long          _n;
+	float         _c0;
+	float         _cn;
+	float         _cmin;
+};
+
+#endif /* EMULATOR_ACCELSTEPPER_H_ */
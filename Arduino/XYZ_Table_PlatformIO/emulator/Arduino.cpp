@@ -0,0 +1,559 @@
+/**
+ * ===============================================================
+ *  Arduino.cpp (emulator)
+ *  XYZ Camera Positioning System - Host Arduino Core Shim
+ * ===============================================================
+ */
+
+#include "Arduino.h"
+#include "Emulator.h"
+
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+
+#include <deque>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+uint8_t SREG  = 0x80;
+uint8_t MCUSR = 0x01;   // PORF: first start is a power-on
+uint8_t  TCCR3A, TCCR3B, TIMSK3, TIFR3;
+uint16_t OCR3A, TCNT3;
+uint8_t  TCCR4A, TCCR4B, TIMSK4, TIFR4;
+uint16_t TCNT4, ICR4;
+uint8_t  UBRR0H, UBRR0L, UCSR0A, UCSR0B, UCSR0C, UDR0;
+
+// Symbols MegaBoard::FreeRam() expects from the AVR linker script.
+int  __heap_start;
+int *__brkval = 0;
+
+/* ========== Time ========== */
+
+static uint64_t monoUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t bootUs = monoUs();
+
+unsigned long micros(void) { return (uint32_t)(monoUs() - bootUs); }
+unsigned long millis(void) { return (uint32_t)((monoUs() - bootUs) / 1000); }
+
+void delay(unsigned long ms)
+{
+	uint64_t end = monoUs() + ms * 1000ULL;
+	while (monoUs() < end) {
+		EmulatorSerialPump();
+		usleep(200);
+	}
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	uint64_t end = monoUs() + us;
+	while (monoUs() < end) {}
+}
+
+/* ========== Timer3, Timer4 ========== */
+
+#define ICP4_PIN 49
+
+static const uint16_t PRESCALE[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+extern "C" __attribute__((weak)) void TIMER3_COMPA_vect(void) {}
+extern "C" __attribute__((weak)) void TIMER4_CAPT_vect(void) {}
+
+// An edge on ICP4 copies the running Timer4 count to ICR4; the count is
+// derived from the host clock, so the ISR sees a capture with no delay.
+static void timer4Capture(uint8_t level)
+{
+	uint16_t prescale = PRESCALE[TCCR4B & 0x07];
+	if (!prescale || !(TIMSK4 & bit(ICIE4)) || !(SREG & 0x80))
+		return;
+	if (!level != !(TCCR4B & bit(ICES4)))
+		return;
+	TCNT4 = ICR4 = (uint16_t)(monoUs() * (F_CPU / 1000000UL) / prescale);
+	TIMER4_CAPT_vect();
+}
+
+void EmulatorTimerPump(void)
+{
+	static uint64_t lastUs;
+
+	uint16_t prescale = PRESCALE[TCCR3B & 0x07];
+	uint64_t now      = monoUs();
+	if (!(TIMSK3 & bit(OCIE3A)) || !prescale || !(SREG & 0x80)) {
+		lastUs = now;
+		return;
+	}
+
+	double   periodUs = (OCR3A + 1.0) * prescale / (F_CPU / 1000000.0);
+	uint64_t due      = (uint64_t)((now - lastUs) / periodUs);
+	if (due == 0)
+		return;
+	lastUs = (due > 2000) ? now : lastUs + (uint64_t)(due * periodUs);
+	for (uint64_t n = (due > 2000 ? 2000 : due); n > 0 && (TIMSK3 & bit(OCIE3A)); n--)
+		TIMER3_COMPA_vect();
+}
+
+/* ========== Watchdog ========== */
+
+static uint64_t wdtTimeoutUs;   // 0 = disabled
+static uint64_t wdtKickUs;
+
+void wdt_enable(uint8_t timeout)
+{
+	wdtTimeoutUs = 16000ULL << timeout;
+	wdtKickUs    = monoUs();
+}
+
+void wdt_disable(void) { wdtTimeoutUs = 0; }
+void wdt_reset(void)   { wdtKickUs = monoUs(); }
+
+bool EmulatorWatchdogExpired(void)
+{
+	return wdtTimeoutUs && monoUs() - wdtKickUs > wdtTimeoutUs;
+}
+
+/* ========== EEPROM ========== */
+
+static uint8_t  eeprom[E2END + 1];
+static int      eepromFd = -1;
+static uint64_t eepromBusyUntilUs;
+
+void EmulatorEepromAttach(const char *path)
+{
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	if (!path)
+		return;
+	eepromFd = open(path, O_RDWR | O_CREAT, 0644);
+	if (eepromFd < 0) {
+		perror("eeprom");
+		return;
+	}
+	if (pread(eepromFd, eeprom, sizeof(eeprom), 0) < (ssize_t)sizeof(eeprom)) {
+		memset(eeprom, 0xFF, sizeof(eeprom));
+		if (pwrite(eepromFd, eeprom, sizeof(eeprom), 0) < 0)
+			perror("eeprom");
+	}
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+	return eeprom[(uintptr_t)addr & E2END];
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+	uintptr_t a = (uintptr_t)addr & E2END;
+	while (!EmulatorEepromReady()) {}
+	if (eeprom[a] == value)
+		return;
+	eeprom[a]         = value;
+	eepromBusyUntilUs = monoUs() + 3300;
+	if (eepromFd >= 0 && pwrite(eepromFd, &value, 1, a) < 0)
+		perror("eeprom");
+}
+
+bool EmulatorEepromReady(void)
+{
+	return monoUs() >= eepromBusyUntilUs;
+}
+
+/* ========== Pins and interrupts ========== */
+
+static volatile uint8_t pinLevel[EMU_PIN_COUNT];
+static volatile uint8_t pcmsk[EMU_PIN_COUNT];
+static volatile uint8_t pcicr;
+static void (*extHandler[6])(void);
+static int extMode[6];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin < EMU_PIN_COUNT && mode == INPUT_PULLUP)
+		pinLevel[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (pin >= EMU_PIN_COUNT)
+		return;
+	pinLevel[pin] = val ? HIGH : LOW;
+	EmulatorPinWritten(pin, pinLevel[pin]);
+}
+
+int digitalRead(uint8_t pin)
+{
+	return pin < EMU_PIN_COUNT ? pinLevel[pin] : LOW;
+}
+
+uint8_t           digitalPinToPort(uint8_t pin)     { return pin; }
+uint8_t           digitalPinToBitMask(uint8_t pin)  { return 1; }
+volatile uint8_t *portInputRegister(uint8_t port)   { return &pinLevel[port]; }
+volatile uint8_t *portOutputRegister(uint8_t port)  { return &pinLevel[port]; }
+
+void noInterrupts(void) { SREG &= ~0x80; }
+void interrupts(void)   { SREG |= 0x80; }
+
+int digitalPinToInterrupt(uint8_t pin)
+{
+	switch (pin) {
+	case 2:  return 0;
+	case 3:  return 1;
+	case 21: return 2;
+	case 20: return 3;
+	case 19: return 4;
+	case 18: return 5;
+	default: return NOT_AN_INTERRUPT;
+	}
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode)
+{
+	if (interruptNum < 6) {
+		extHandler[interruptNum] = handler;
+		extMode[interruptNum]    = mode;
+	}
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+	if (interruptNum < 6)
+		extHandler[interruptNum] = 0;
+}
+
+// Mega 2560 pin-change groups: PCINT0 = 10-13, 50-53; PCINT1 = 14, 15;
+// PCINT2 = A8-A15 (62-69).
+static int pcGroup(uint8_t pin)
+{
+	if ((pin >= 10 && pin <= 13) || (pin >= 50 && pin <= 53)) return 0;
+	if (pin == 14 || pin == 15)                               return 1;
+	if (pin >= 62 && pin <= 69)                               return 2;
+	return -1;
+}
+
+// Groups the firmware leaves out (AXES_PCINT_VECTORS) go nowhere, as an
+// unused vector on the Mega.
+extern "C" __attribute__((weak)) void PCINT0_vect(void) {}
+extern "C" __attribute__((weak)) void PCINT1_vect(void) {}
+extern "C" __attribute__((weak)) void PCINT2_vect(void) {}
+
+volatile uint8_t *digitalPinToPCICR(uint8_t pin)    { return pcGroup(pin) < 0 ? 0 : &pcicr; }
+uint8_t           digitalPinToPCICRbit(uint8_t pin) { return pcGroup(pin) < 0 ? 0 : pcGroup(pin); }
+volatile uint8_t *digitalPinToPCMSK(uint8_t pin)    { return pin < EMU_PIN_COUNT ? &pcmsk[pin] : 0; }
+uint8_t           digitalPinToPCMSKbit(uint8_t pin) { return 0; }
+
+uint8_t EmulatorPinLevel(uint8_t pin)
+{
+	return pin < EMU_PIN_COUNT ? pinLevel[pin] : LOW;
+}
+
+void EmulatorSetPin(uint8_t pin, uint8_t level)
+{
+	if (pin >= EMU_PIN_COUNT || pinLevel[pin] == level)
+		return;
+	pinLevel[pin] = level;
+
+	if (pin == ICP4_PIN)
+		timer4Capture(level);
+
+	int ext = digitalPinToInterrupt(pin);
+	if (ext != NOT_AN_INTERRUPT) {
+		int mode = extMode[ext];
+		if (extHandler[ext] && (mode == CHANGE || (mode == FALLING && !level) || (mode == RISING && level)))
+			extHandler[ext]();
+		return;
+	}
+
+	int group = pcGroup(pin);
+	if (group >= 0 && pcmsk[pin] && (pcicr & bit(group))) {
+		if (group == 0)      PCINT0_vect();
+		else if (group == 1) PCINT1_vect();
+		else                 PCINT2_vect();
+	}
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+/* ========== String ========== */
+
+static std::string numberToString(unsigned long value, unsigned char base, bool negative)
+{
+	char buf[40];
+	char *p = buf + sizeof(buf) - 1;
+	*p = '\0';
+	do {
+		int d = value % base;
+		*--p = d < 10 ? '0' + d : 'A' + d - 10;
+		value /= base;
+	} while (value);
+	if (negative)
+		*--p = '-';
+	return p;
+}
+
+String::String(unsigned char value, unsigned char base) : s(numberToString(value, base, false)) {}
+String::String(unsigned int value, unsigned char base)  : s(numberToString(value, base, false)) {}
+String::String(unsigned long value, unsigned char base) : s(numberToString(value, base, false)) {}
+String::String(int value, unsigned char base)
+	: s(base == 10 ? numberToString(value < 0 ? -(long)value : value, 10, value < 0)
+	               : numberToString((unsigned int)value, base, false)) {}
+String::String(long value, unsigned char base)
+	: s(base == 10 ? numberToString(value < 0 ? -value : value, 10, value < 0)
+	               : numberToString((unsigned long)value, base, false)) {}
+
+String::String(float value, unsigned char decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+	char buf[48];
+	snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+	s = buf;
+}
+
+int String::indexOf(char c) const
+{
+	size_t pos = s.find(c);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char *str) const
+{
+	size_t pos = s.find(str);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+	return substring(beginIndex, s.size());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+	if (beginIndex > endIndex) { unsigned int t = beginIndex; beginIndex = endIndex; endIndex = t; }
+	if (beginIndex >= s.size()) return String();
+	if (endIndex > s.size()) endIndex = s.size();
+	return String(s.substr(beginIndex, endIndex - beginIndex).c_str());
+}
+
+bool String::startsWith(const String &prefix) const
+{
+	return s.compare(0, prefix.s.size(), prefix.s) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &other) const
+{
+	return s.size() == other.s.size() && strcasecmp(s.c_str(), other.s.c_str()) == 0;
+}
+
+void String::toLowerCase() { for (size_t i = 0; i < s.size(); i++) s[i] = tolower(s[i]); }
+void String::toUpperCase() { for (size_t i = 0; i < s.size(); i++) s[i] = toupper(s[i]); }
+
+void String::trim()
+{
+	size_t b = s.find_first_not_of(" \t\r\n");
+	size_t e = s.find_last_not_of(" \t\r\n");
+	s = (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+}
+
+/* ========== Print ========== */
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+size_t Print::print(const char *str)
+{
+	size_t n = 0;
+	while (*str)
+		n += write((uint8_t)*str++);
+	return n;
+}
+
+size_t Print::print(long n, int base)         { return print(String(n, (unsigned char)base)); }
+size_t Print::print(unsigned long n, int base) { return print(String(n, (unsigned char)base)); }
+size_t Print::print(double n, int digits)      { return print(String(n, (unsigned char)digits)); }
+
+/* ========== Serial over pty ========== */
+
+struct TimedByte {
+	uint64_t at;    // when the last bit of the byte has crossed the wire
+	uint8_t  value;
+};
+
+static int                   serialFd = -1;
+static uint64_t              byteUs   = 87;      // 10 bits at 115200
+static unsigned long         uartBaud = 115200;
+static std::deque<TimedByte> rxWire;             // read from the pty, still "on the wire"
+static std::deque<TimedByte> txWire;             // written by firmware, not yet delivered
+static uint64_t              rxLineFreeUs;
+static uint64_t              txLineFreeUs;
+static uint32_t              rxDropped;
+static HardwareSerial       *uart;               // the port begin() was last called on
+
+HardwareSerial Serial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0);
+
+void EmulatorSerialAttach(int fd)
+{
+	serialFd = fd;
+}
+
+uint32_t EmulatorSerialRxDropped(void)
+{
+	return rxDropped;
+}
+
+// The rate the host set on the pty, 0 when it cannot be told (custom
+// rates such as 250000): then every rate gets through.
+static unsigned long hostBaud(void)
+{
+	struct termios t;
+	if (tcgetattr(serialFd, &t) < 0)
+		return 0;
+	switch (cfgetospeed(&t)) {
+	case B57600:  return 57600;
+	case B115200: return 115200;
+	case B230400: return 230400;
+#ifdef B500000
+	case B500000:  return 500000;
+	case B1000000: return 1000000;
+	case B2000000: return 2000000;
+#endif
+	default:      return 0;
+	}
+}
+
+// Bytes sent at the wrong rate arrive as framing garbage. The rate is
+// looked up (a syscall) once per pump, and only when a byte crosses.
+static uint8_t overWire(uint8_t c, int &garbled)
+{
+	if (garbled < 0) {
+		unsigned long host = hostBaud();
+		garbled = host && host != uartBaud;
+	}
+	return garbled ? 0xFF : c;
+}
+
+void EmulatorSerialPump(void)
+{
+	if (serialFd < 0)
+		return;
+
+	uint64_t now     = monoUs();
+	int      garbled = -1;
+
+	uint8_t buf[256];
+	ssize_t n;
+	while ((n = ::read(serialFd, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < n; i++) {
+			rxLineFreeUs = max(rxLineFreeUs, now) + byteUs;
+			rxWire.push_back({rxLineFreeUs, overWire(buf[i], garbled)});
+		}
+	}
+
+	// Held on the wire while interrupts are off, like the UART's own FIFO.
+	while (!rxWire.empty() && rxWire.front().at <= now && (SREG & 0x80)) {
+		UDR0 = rxWire.front().value;
+		rxWire.pop_front();
+		if (uart && uart->_rx_full())
+			rxDropped++;    // the real UART overwrites nothing; the byte is lost
+		USART0_RX_vect();
+	}
+
+	while (!txWire.empty() && txWire.front().at <= now) {
+		uint8_t out[256];
+		size_t  cnt = 0;
+		while (!txWire.empty() && txWire.front().at <= now && cnt < sizeof(out)) {
+			out[cnt++] = overWire(txWire.front().value, garbled);
+			txWire.pop_front();
+		}
+		if (::write(serialFd, out, cnt) < 0 && errno != EAGAIN)
+			break;
+	}
+}
+
+extern "C" __attribute__((weak)) void USART0_RX_vect(void) { Serial._rx_complete_irq(); }
+
+void HardwareSerial::_rx_complete_irq(void)
+{
+	rx_buffer_index_t i = (rx_buffer_index_t)(_rx_buffer_head + 1) % SERIAL_RX_BUFFER_SIZE;
+	if (i != _rx_buffer_tail) {
+		_rx_buffer[_rx_buffer_head] = *_udr;
+		_rx_buffer_head = i;
+	}
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+	uart     = this;
+	uartBaud = baud;
+	byteUs   = (10ULL * 1000000ULL + baud - 1) / baud;
+}
+
+int HardwareSerial::available(void)
+{
+	EmulatorSerialPump();
+	return ((unsigned int)(SERIAL_RX_BUFFER_SIZE + _rx_buffer_head - _rx_buffer_tail)) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek(void)
+{
+	EmulatorSerialPump();
+	return _rx_buffer_head == _rx_buffer_tail ? -1 : _rx_buffer[_rx_buffer_tail];
+}
+
+int HardwareSerial::read(void)
+{
+	EmulatorSerialPump();
+	if (_rx_buffer_head == _rx_buffer_tail)
+		return -1;
+	unsigned char c = _rx_buffer[_rx_buffer_tail];
+	_rx_buffer_tail = (rx_buffer_index_t)(_rx_buffer_tail + 1) % SERIAL_RX_BUFFER_SIZE;
+	return c;
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+	EmulatorSerialPump();
+	return EMU_SERIAL_TX_BUFFER - (int)min(txWire.size(), (size_t)EMU_SERIAL_TX_BUFFER);
+}
+
+void HardwareSerial::flush(void)
+{
+	while (!txWire.empty()) {
+		EmulatorSerialPump();
+		usleep(50);
+	}
+}
+
+// Like the AVR core: returns at once while the TX buffer has room, otherwise
+// blocks until the UART has shifted enough bytes out.
+size_t HardwareSerial::write(uint8_t c)
+{
+	while (txWire.size() >= EMU_SERIAL_TX_BUFFER) {
+		EmulatorSerialPump();
+		usleep(20);
+	}
+	uint64_t now = monoUs();
+	txLineFreeUs = max(txLineFreeUs, now) + byteUs;
+	txWire.push_back({txLineFreeUs, c});
+	return 1;
+}
@@ -0,0 +1,262 @@
+/**
+ * ===============================================================
+ *  Arduino.h (emulator)
+ *  XYZ Camera Positioning System - Host Arduino Core Shim
+ * ===============================================================
+ *  Description:
+ *  - The subset of the Arduino/AVR core the firmware uses, backed by
+ *    the host: clock_gettime for time, a pty for Serial, plain arrays
+ *    for pins, interrupts and port registers.
+ *  - Pin numbering, external-interrupt and pin-change mapping follow
+ *    the Mega 2560; what the core cannot cover goes through the
+ *    firmware's BoardShim.h.
+ * ===============================================================
+ */
+
+#ifndef EMULATOR_ARDUINO_H_
+#define EMULATOR_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+#include "avr/pgmspace.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+
+#define NOT_AN_INTERRUPT -1
+#define EMU_PIN_COUNT    70     // Mega 2560 digital + analog pins
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+// Functions rather than the core's macros so host STL headers still compile.
+template <typename T, typename U>
+inline typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template <typename T, typename U>
+inline typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bit(b) (1UL << (b))
+#define PI 3.1415926535897932384626433832795
+
+/* Time */
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/* Pins */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int  digitalRead(uint8_t pin);
+
+// Every pin is its own one-bit "port", so the firmware's cached register
+// reads see exactly the level of that pin.
+uint8_t           digitalPinToPort(uint8_t pin);
+uint8_t           digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portInputRegister(uint8_t port);
+volatile uint8_t *portOutputRegister(uint8_t port);
+
+/* Interrupts */
+extern uint8_t SREG;
+extern uint8_t MCUSR;
+#define _BV(bit) (1 << (bit))
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+/* Timer3 (16-bit), enough for a CTC compare-match interrupt */
+#define F_CPU 16000000UL
+extern uint8_t  TCCR3A, TCCR3B, TIMSK3, TIFR3;
+extern uint16_t OCR3A, TCNT3;
+#define WGM32  3
+#define CS30   0
+#define CS31   1
+#define CS32   2
+#define OCIE3A 1
+#define OCF3A  1
+
+/* Timer4 (16-bit), input capture on ICP4 = pin 49 */
+extern uint8_t  TCCR4A, TCCR4B, TIMSK4, TIFR4;
+extern uint16_t TCNT4, ICR4;
+#define CS40  0
+#define CS41  1
+#define CS42  2
+#define ICES4 6
+#define ICNC4 7
+#define ICIE4 5
+#define ICF4  5
+
+/* USART0: each received byte passes through UDR0 and USART0_RX_vect */
+extern uint8_t UBRR0H, UBRR0L, UCSR0A, UCSR0B, UCSR0C, UDR0;
+#define UPE0 2
+#define bit_is_set(sfr, bit)   ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+void noInterrupts(void);
+void interrupts(void);
+#define cli() noInterrupts()
+#define sei() interrupts()
+int  digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+volatile uint8_t *digitalPinToPCICR(uint8_t pin);   // null if not a PCINT pin
+uint8_t           digitalPinToPCICRbit(uint8_t pin);
+volatile uint8_t *digitalPinToPCMSK(uint8_t pin);
+uint8_t           digitalPinToPCMSKbit(uint8_t pin);
+
+#define ISR(vector) extern "C" void vector(void)
+extern "C" void PCINT0_vect(void);
+extern "C" void PCINT1_vect(void);
+extern "C" void PCINT2_vect(void);
+extern "C" void TIMER3_COMPA_vect(void);
+extern "C" void TIMER4_CAPT_vect(void);
+extern "C" void USART0_RX_vect(void);
+extern "C" void USART0_UDRE_vect(void);
+
+/* Emulator hooks (defined in main.cpp) */
+void EmulatorPinWritten(uint8_t pin, uint8_t val);
+void EmulatorReboot(void);
+void EmulatorKeepNoinit(void *data, size_t size);   // .noinit data to carry across reboots
+bool EmulatorAtReset(void (*init)(void));           // run at each reset, before setup()
+
+/* Strings */
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class String {
+public:
+	String(const char *cstr = "") : s(cstr ? cstr : "") {}
+	String(const String &str) : s(str.s) {}
+	String(const __FlashStringHelper *str) : s(reinterpret_cast<const char *>(str)) {}
+	explicit String(char c) : s(1, c) {}
+	explicit String(unsigned char value, unsigned char base = 10);
+	explicit String(int value, unsigned char base = 10);
+	explicit String(unsigned int value, unsigned char base = 10);
+	explicit String(long value, unsigned char base = 10);
+	explicit String(unsigned long value, unsigned char base = 10);
+	explicit String(float value, unsigned char decimalPlaces = 2);
+	explicit String(double value, unsigned char decimalPlaces = 2);
+
+	String &operator=(const String &rhs) { s = rhs.s; return *this; }
+	String &operator=(const char *cstr)  { s = cstr; return *this; }
+
+	String &operator+=(const String &rhs) { s += rhs.s; return *this; }
+	String &operator+=(const char *cstr)  { s += cstr; return *this; }
+	String &operator+=(char c)            { s += c; return *this; }
+
+	friend String operator+(const String &lhs, const String &rhs) { String r(lhs); r += rhs; return r; }
+	friend String operator+(const String &lhs, const char *rhs)   { String r(lhs); r += rhs; return r; }
+	friend String operator+(const char *lhs, const String &rhs)   { String r(lhs); r += rhs; return r; }
+	friend String operator+(const String &lhs, char rhs)          { String r(lhs); r += rhs; return r; }
+
+	bool operator==(const String &rhs) const { return s == rhs.s; }
+	bool operator==(const char *cstr) const  { return s == cstr; }
+	bool operator!=(const String &rhs) const { return s != rhs.s; }
+	bool operator!=(const char *cstr) const  { return s != cstr; }
+	char operator[](unsigned int index) const { return charAt(index); }
+
+	unsigned int length() const { return s.size(); }
+	const char  *c_str() const  { return s.c_str(); }
+	char         charAt(unsigned int index) const { return index < s.size() ? s[index] : 0; }
+	void         reserve(unsigned int size) { s.reserve(size); }
+
+	int    indexOf(char c) const;
+	int    indexOf(const char *str) const;
+	String substring(unsigned int beginIndex) const;
+	String substring(unsigned int beginIndex, unsigned int endIndex) const;
+	bool   startsWith(const String &prefix) const;
+	bool   startsWith(const char *prefix) const { return startsWith(String(prefix)); }
+	bool   equalsIgnoreCase(const String &other) const;
+	long   toInt() const   { return atol(s.c_str()); }
+	float  toFloat() const { return (float)atof(s.c_str()); }
+	void   toLowerCase();
+	void   toUpperCase();
+	void   trim();
+
+private:
+	std::string s;
+};
+
+/* Serial */
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	size_t write(const uint8_t *buffer, size_t size);
+
+	size_t print(const char *str);
+	size_t print(const String &str)                { return print(str.c_str()); }
+	size_t print(const __FlashStringHelper *str)   { return print(reinterpret_cast<const char *>(str)); }
+	size_t print(char c)                           { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = DEC)  { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC)            { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC)   { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	size_t println(void)                           { return print("\r\n"); }
+	template <typename T>
+	size_t println(const T &value)                 { size_t n = print(value); return n + println(); }
+};
+
+// The receive side keeps the AVR core's ring and member names, so a
+// subclass with its own USART0_RX_vect (MegaBoard's BoardUart) builds as is.
+#define SERIAL_RX_BUFFER_SIZE 64
+typedef uint8_t rx_buffer_index_t;
+
+class HardwareSerial : public Print {
+public:
+	HardwareSerial(volatile uint8_t *ubrrh, volatile uint8_t *ubrrl, volatile uint8_t *ucsra,
+	               volatile uint8_t *ucsrb, volatile uint8_t *ucsrc, volatile uint8_t *udr)
+		: _ucsra(ucsra), _udr(udr), _rx_buffer_head(0), _rx_buffer_tail(0) {}
+
+	void   begin(unsigned long baud);
+	void   end(void) {}
+	int    available(void);
+	int    peek(void);
+	virtual int read(void);
+	int    availableForWrite(void);
+	void   flush(void);
+	size_t write(uint8_t c);
+	using Print::write;
+	operator bool() { return true; }
+
+	void   _rx_complete_irq(void);   // as the AVR core: buffers UDR0
+	void   _tx_udr_empty_irq(void) {}
+	bool   _rx_full(void) { return (rx_buffer_index_t)(_rx_buffer_head + 1) % SERIAL_RX_BUFFER_SIZE == _rx_buffer_tail; }
+
+protected:
+	volatile uint8_t *const    _ucsra;
+	volatile uint8_t *const    _udr;
+	volatile rx_buffer_index_t _rx_buffer_head;
+	volatile rx_buffer_index_t _rx_buffer_tail;
+	unsigned char              _rx_buffer[SERIAL_RX_BUFFER_SIZE];
+};
+
+extern HardwareSerial Serial;
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+#endif /* EMULATOR_ARDUINO_H_ */
@@ -0,0 +1,44 @@
+/**
+ * ===============================================================
+ *  Emulator.h
+ *  XYZ Camera Positioning System - Host Emulator Internals
+ * ===============================================================
+ *  Description:
+ *  - Hooks between the Arduino shim (Arduino.cpp) and the emulator
+ *    main loop (main.cpp): pty attachment, serial pacing and
+ *    externally driven input pins.
+ * ===============================================================
+ */
+
+#ifndef EMULATOR_H_
+#define EMULATOR_H_
+
+#include <stdint.h>
+
+// Serial runs over this fd (pty master); bytes are paced at the baud rate
+// passed to begin() and the RX side keeps the Mega's 64-byte ring
+// (SERIAL_RX_BUFFER_SIZE).
+#define EMU_SERIAL_TX_BUFFER 64
+
+void     EmulatorSerialAttach(int fd);
+void     EmulatorSerialPump(void);          // move bytes between pty and UART model
+uint32_t EmulatorSerialRxDropped(void);     // bytes lost to RX buffer overflow
+
+// Drives an input pin from outside (limit switch, encoder) and fires the
+// external or pin-change interrupt attached to it, like the hardware would.
+void    EmulatorSetPin(uint8_t pin, uint8_t level);
+uint8_t EmulatorPinLevel(uint8_t pin);
+
+// EEPROM contents are loaded from and written through to `path` (null:
+// starts erased and is lost on exit).
+void EmulatorEepromAttach(const char *path);
+
+// Runs the Timer3 compare-match interrupt for every period elapsed since the
+// last call (capped, so a stalled host does not replay a burst of seconds).
+void EmulatorTimerPump(void);
+
+// True once the firmware has enabled the watchdog and not kicked it for
+// longer than the timeout.
+bool EmulatorWatchdogExpired(void);
+
+#endif /* EMULATOR_H_ */
@@ -0,0 +1,2 @@
+/* Emulator: HardwareSerial lives in Arduino.h. */
+#include "Arduino.h"
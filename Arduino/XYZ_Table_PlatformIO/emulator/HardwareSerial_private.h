@@ -0,0 +1,2 @@
+/* Emulator: HardwareSerial and the UCSR0A bit names live in Arduino.h. */
+#include "Arduino.h"
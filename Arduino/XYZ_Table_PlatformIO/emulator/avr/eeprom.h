@@ -0,0 +1,17 @@
+/* Emulator: the Mega's 4 KB EEPROM, optionally backed by a file (--eeprom). */
+#ifndef EMULATOR_EEPROM_H_
+#define EMULATOR_EEPROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0xFFF
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void    eeprom_read_block(void *dst, const void *src, size_t n);
+void    eeprom_update_byte(uint8_t *addr, uint8_t value);
+bool    EmulatorEepromReady(void);   // false for 3.3 ms after each programmed byte
+
+#define eeprom_is_ready() EmulatorEepromReady()
+
+#endif /* EMULATOR_EEPROM_H_ */
@@ -0,0 +1,2 @@
+/* Emulator: registers are plain variables declared in Arduino.h. */
+#include "../Arduino.h"
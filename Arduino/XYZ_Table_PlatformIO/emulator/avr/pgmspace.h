@@ -0,0 +1,23 @@
+/* Emulator: program memory is ordinary memory on the host. */
+#ifndef EMULATOR_PGMSPACE_H_
+#define EMULATOR_PGMSPACE_H_
+
+#include <string.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define strcpy_P  strcpy
+#define strncpy_P strncpy
+#define strcmp_P  strcmp
+#define strlen_P  strlen
+#define memcpy_P  memcpy
+
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_float(addr) (*(const float *)(addr))
+#define pgm_read_ptr(addr)   (*(void *const *)(addr))
+
+#endif /* EMULATOR_PGMSPACE_H_ */
@@ -0,0 +1,296 @@
+/**
+ * ===============================================================
+ *  main.cpp (emulator)
+ *  XYZ Camera Positioning System - Host Firmware Emulator
+ * ===============================================================
+ *  Description:
+ *  - Runs the firmware (setup()/loop()) on the host with its serial
+ *    port exposed on a pseudo-terminal, so the Python bridge and
+ *    clients can be exercised without a Mega attached.
+ *  - Optional travel simulation: STEP/DIR pulses move a virtual stage
+ *    and the limit switch pins close at the ends of travel.
+ *
+ *  - Optional camera strobe: --strobe HZ pulses the strobe input (ICP4)
+ *    high for 1 ms per frame.
+ *
+ *  - Reboots (the 'reboot' command or a watchdog timeout) keep the pty,
+ *    the stage position and the firmware's .noinit data, like a reset
+ *    of the Mega; --eeprom keeps the EEPROM in a file across runs.
+ *
+ *  Usage: xyz-emulator [--link PATH] [--travel UNITS] [--loop-us US]
+ *                      [--eeprom FILE] [--strobe HZ]
+ * ===============================================================
+ */
+
+#include "Arduino.h"
+#include "Emulator.h"
+#include "AxesConfig.h"
+#include "Strobe.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+void setup(void);
+void loop(void);
+
+static std::vector<char *> launchArgs;
+static int                 masterFd = -1;
+static long                travelUnits;          // 0 = no travel simulation
+static double              strobeHz;             // 0 = no camera strobe
+static long                stagePos[AXIS_COUNT]; // physical position in (fine) steps
+static std::string         linkPath;
+static FILE               *resumeFile;          // state handed over by the last reboot
+static std::vector<std::pair<void *, size_t> > noinitRegions;
+
+/* ========== Travel simulation ========== */
+
+// Microsteps per pulse selected by the MS1-MS3 levels, in fine steps:
+// like the driver's indexer, a pulse moves to the next position that is
+// valid in the selected mode.
+static long microstepIncrement(const MicrostepConfig &ms)
+{
+    if (ms.fine == 0)
+        return 1;
+    uint8_t levels = (ms.ms1Pin != NO_PIN && EmulatorPinLevel(ms.ms1Pin) ? 1 : 0) |
+                     (ms.ms2Pin != NO_PIN && EmulatorPinLevel(ms.ms2Pin) ? 2 : 0) |
+                     (ms.ms3Pin != NO_PIN && EmulatorPinLevel(ms.ms3Pin) ? 4 : 0);
+    for (uint8_t i = 0; i < MICROSTEP_MODES; i++)
+        if (MICROSTEP_PATTERNS[i] == levels && (1 << i) <= ms.fine)
+            return ms.fine >> i;
+    return 1;
+}
+
+static void updateSwitches(uint8_t axis)
+{
+    const AxisConfig &cfg   = AXES_CONFIG[axis];
+    long              limit = travelUnits * cfg.settings.stepsPerUnit;
+    if (cfg.minPin != NO_PIN)
+        EmulatorSetPin(cfg.minPin, stagePos[axis] <= -limit ? LOW : HIGH);
+    if (cfg.maxPin != NO_PIN)
+        EmulatorSetPin(cfg.maxPin, stagePos[axis] >= limit ? LOW : HIGH);
+}
+
+// The stage moves on the rising edge of STEP, in the direction given by
+// the DIR level (undoing the axis inversion so it matches the firmware's
+// logical position). Switches sit at +/- travelUnits from power-on.
+void EmulatorPinWritten(uint8_t pin, uint8_t val)
+{
+    if (!travelUnits || val != HIGH)
+        return;
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        const AxisConfig &cfg = AXES_CONFIG[i];
+        if (pin != cfg.stepPin)
+            continue;
+
+        bool forward = EmulatorPinLevel(cfg.dirPin) ^ cfg.settings.invertDirection;
+        long inc     = microstepIncrement(cfg.microstep);
+        long cell    = stagePos[i] / inc - (stagePos[i] % inc < 0 ? 1 : 0);  // floor
+        if (forward)
+            stagePos[i] = (cell + 1) * inc;
+        else
+            stagePos[i] = (stagePos[i] == cell * inc) ? (cell - 1) * inc : cell * inc;
+
+        updateSwitches(i);
+        return;
+    }
+}
+
+/* ========== Camera strobe ========== */
+
+static void updateStrobe()
+{
+    static unsigned long frameUs;
+    static bool          high;
+
+    unsigned long now    = micros();
+    unsigned long period = (unsigned long)(1e6 / strobeHz);
+    if (!high && now - frameUs >= period) {
+        frameUs = (now - frameUs < 2 * period) ? frameUs + period : now;
+        EmulatorSetPin(STROBE_PIN, HIGH);
+        high = true;
+    } else if (high && now - frameUs >= 1000) {
+        EmulatorSetPin(STROBE_PIN, LOW);
+        high = false;
+    }
+}
+
+/* ========== Reboot ========== */
+
+// What the Mega runs from .init3 at reset (see BOARD_EARLY_INIT); here
+// after MCUSR is set, before setup().
+static std::vector<void (*)(void)> &resetHooks()
+{
+    static std::vector<void (*)(void)> hooks;
+    return hooks;
+}
+
+bool EmulatorAtReset(void (*init)(void))
+{
+    resetHooks().push_back(init);
+    return true;
+}
+
+// The firmware registers each .noinit object at boot, always in the same
+// order; after a reboot its contents are read back from the hand-over file.
+void EmulatorKeepNoinit(void *data, size_t size)
+{
+    noinitRegions.push_back(std::make_pair(data, size));
+    if (resumeFile && fread(data, 1, size, resumeFile) != size)
+        memset(data, 0, size);
+}
+
+// A reboot re-executes the emulator, handing the pty over so the connected
+// client keeps its port, together with what a reset of the Mega keeps: the
+// stage where it is and the .noinit RAM.
+void EmulatorReboot(void)
+{
+    Serial.flush();
+
+    std::string resumePath = "/tmp/xyz-emulator-" + std::to_string(getpid()) + ".resume";
+    FILE *f = fopen(resumePath.c_str(), "wb");
+    if (f) {
+        fwrite(stagePos, sizeof(stagePos), 1, f);
+        for (size_t i = 0; i < noinitRegions.size(); i++)
+            fwrite(noinitRegions[i].first, noinitRegions[i].second, 1, f);
+        fclose(f);
+    } else {
+        perror("reboot");
+    }
+
+    std::vector<char *> args;
+    std::string         fdArg = std::to_string(masterFd);
+    args.push_back(launchArgs[0]);
+    for (size_t i = 1; i < launchArgs.size(); i++) {
+        if (!strcmp(launchArgs[i], "--fd") || !strcmp(launchArgs[i], "--link") ||
+            !strcmp(launchArgs[i], "--resume")) {
+            i++;
+            continue;
+        }
+        args.push_back(launchArgs[i]);
+    }
+    args.push_back((char *)"--fd");
+    args.push_back((char *)fdArg.c_str());
+    if (f) {
+        args.push_back((char *)"--resume");
+        args.push_back((char *)resumePath.c_str());
+    }
+    args.push_back(0);
+
+    execv("/proc/self/exe", args.data());
+    perror("reboot");
+    exit(1);
+}
+
+/* ========== Startup ========== */
+
+static int openPty(void)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("posix_openpt");
+        exit(1);
+    }
+
+    // Raw mode on the slave; keeping it open means the master never sees
+    // EIO when a client disconnects.
+    int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    return fd;
+}
+
+static void onSignal(int)
+{
+    if (!linkPath.empty())
+        unlink(linkPath.c_str());
+    _exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    long        loopUs = 50;
+    bool        warm   = false;
+    const char *eepromPath = 0;
+
+    launchArgs.assign(argv, argv + argc);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--link" && i + 1 < argc) {
+            linkPath = argv[++i];
+        } else if (arg == "--travel" && i + 1 < argc) {
+            travelUnits = atol(argv[++i]);
+        } else if (arg == "--loop-us" && i + 1 < argc) {
+            loopUs = atol(argv[++i]);
+        } else if (arg == "--strobe" && i + 1 < argc) {
+            strobeHz = atof(argv[++i]);
+        } else if (arg == "--eeprom" && i + 1 < argc) {
+            eepromPath = argv[++i];
+        } else if (arg == "--fd" && i + 1 < argc) {
+            masterFd = atoi(argv[++i]);
+            warm     = true;
+        } else if (arg == "--resume" && i + 1 < argc) {
+            resumeFile = fopen(argv[++i], "rb");
+            if (resumeFile) {
+                unlink(argv[i]);
+                if (fread(stagePos, sizeof(stagePos), 1, resumeFile) != 1)
+                    memset(stagePos, 0, sizeof(stagePos));
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--link PATH] [--travel UNITS] [--loop-us US] [--eeprom FILE]"
+                    " [--strobe HZ]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (masterFd < 0) {
+        masterFd = openPty();
+        printf("Serial on %s\n", ptsname(masterFd));
+        if (!linkPath.empty()) {
+            unlink(linkPath.c_str());
+            if (symlink(ptsname(masterFd), linkPath.c_str()) == 0)
+                printf("Linked %s\n", linkPath.c_str());
+            else
+                perror("symlink");
+        }
+        fflush(stdout);
+    }
+    fcntl(masterFd, F_SETFL, fcntl(masterFd, F_GETFL) | O_NONBLOCK);
+    EmulatorSerialAttach(masterFd);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    if (warm)
+        MCUSR = _BV(WDRF);  // 'reboot' and timeouts both go through the watchdog
+    EmulatorEepromAttach(eepromPath);
+
+    for (uint8_t pin = 0; pin < EMU_PIN_COUNT; pin++)
+        EmulatorSetPin(pin, HIGH);   // idle inputs read as pulled up
+    if (travelUnits)
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            updateSwitches(i);
+    if (strobeHz > 0)
+        EmulatorSetPin(STROBE_PIN, LOW);
+
+    for (size_t i = 0; i < resetHooks().size(); i++)
+        resetHooks()[i]();
+    setup();
+    for (;;) {
+        loop();
+        EmulatorSerialPump();
+        EmulatorTimerPump();
+        if (strobeHz > 0)
+            updateStrobe();
+        if (EmulatorWatchdogExpired())
+            EmulatorReboot();
+        if (loopUs > 0)
+            usleep(loopUs);
+    }
+}
@@ -0,0 +1,15 @@
+/* Emulator: plain C version of avr-libc's CRC-16 (polynomial 0xA001). */
+#ifndef EMULATOR_CRC16_H_
+#define EMULATOR_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data)
+{
+	crc ^= data;
+	for (uint8_t i = 0; i < 8; i++)
+		crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+	return crc;
+}
+
+#endif /* EMULATOR_CRC16_H_ */
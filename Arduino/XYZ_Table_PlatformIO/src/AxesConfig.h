@@ -0,0 +1,108 @@
+/**
+ * ===============================================================
+ *  AxesConfig.h
+ *  XYZ Camera Positioning System - Compile-time Axis Table
+ * ===============================================================
+ *  Description:
+ *  - One descriptor per motor axis: CLI name, driver pins, limit
+ *    switch pins and the motor settings loaded at startup.
+ *  - StepperMotors, ControlService and the CLI iterate over this
+ *    table, so adding an axis only means adding a row here.
+ *  - Limit pins may be external-interrupt pins (2, 3, 18-21) or
+ *    pin-change pins (10-15, 50-53, A8-A15); NO_PIN leaves an end
+ *    without a switch. Pin-change pins also need their group in
+ *    AXES_PCINT_VECTORS.
+ *  - Soft travel limits sit softMargin units inside the positions where
+ *    the limit switches were last seen to trigger.
+ *  - An optional quadrature encoder per axis is compared against the
+ *    commanded position to detect lost steps (^STALL).
+ *  - Optional MS1-MS3 pins let an axis run long, fast moves at a coarse
+ *    microstep resolution and position at the fine one.
+ * ===============================================================
+ */
+
+#ifndef AXESCONFIG_H_
+#define AXESCONFIG_H_
+
+#include <stdint.h>
+
+#define NO_PIN 0xFF
+
+struct MotorSettings {
+    float    maxSpeed;
+    float    acceleration;
+    uint16_t stepsPerUnit;
+    bool     invertDirection;
+    bool     enable;
+    float    softMargin;        // units kept inside a learned switch position; 0 = off
+};
+
+// Quadrature encoder on the motor or stage. `{}` (all zeros) means
+// "no encoder" (countsPerRev == 0).
+struct EncoderConfig {
+    uint8_t  pinA;          // pin-change or external-interrupt pins
+    uint8_t  pinB;
+    int16_t  countsPerRev;  // x4 quadrature counts per motor rev; negative flips direction
+    uint16_t stepsPerRev;   // motor steps per rev, including microstepping
+    uint16_t stallSteps;    // |commanded - measured| in steps that raises ^STALL
+};
+
+// MS3/MS2/MS1 levels (bit 2..0) indexed by log2(microsteps): A4988, 1 to 16.
+// For a DRV8825 (MODE2..0, 1 to 32) use { 0b000, 0b001, 0b010, 0b011, 0b100, 0b101 }.
+constexpr uint8_t MICROSTEP_PATTERNS[] = { 0b000, 0b001, 0b010, 0b011, 0b111 };
+constexpr uint8_t MICROSTEP_MODES = sizeof(MICROSTEP_PATTERNS) / sizeof(MICROSTEP_PATTERNS[0]);
+
+// Driver microstep select. stepsPerUnit, positions and speeds always refer
+// to the fine resolution; a move that would go faster than coarseSpeed runs
+// at the coarse one, so AccelStepper emits fine/coarse times fewer pulses.
+// `{}` (all zeros): fixed microstepping, no pins driven.
+struct MicrostepConfig {
+    uint8_t  ms1Pin;        // NO_PIN leaves that input to the board jumpers
+    uint8_t  ms2Pin;
+    uint8_t  ms3Pin;
+    uint8_t  fine;          // microsteps per full step, power of two
+    uint8_t  coarse;        // 0 = no switching
+    uint16_t coarseSpeed;   // fine steps/s above which a move runs coarse
+};
+
+struct AxisConfig {
+    char          name;       // single letter used on the CLI (upper case)
+    uint8_t       stepPin;
+    uint8_t       dirPin;
+    uint8_t       enablePin;  // active-low
+    uint8_t       minPin;     // limit switch, active-low, or NO_PIN
+    uint8_t       maxPin;
+    MotorSettings settings;   // defaults loaded at startup
+    EncoderConfig encoder;    // optional
+    MicrostepConfig microstep; // optional
+};
+
+constexpr AxisConfig AXES_CONFIG[] = {
+    // name step dir  en  min     max     maxSpeed accel   steps/unit inverted enable softMargin
+    { 'X',   7,   6,   5,  2,      3,     { 800.0f, 100.0f, 100,       true,    true,  2.0f }, {}, {} },
+    { 'Y',  25,  26,  27, 18,     19,     { 300.0f,   8.0f,   8,       false,   true,  2.0f }, {}, {} },
+    { 'Z',  28,  29,  30, 20,     21,     { 300.0f,   8.0f,   8,       true,    true,  2.0f }, {}, {} },
+    // Examples for extra stages on the same Mega (pin-change limit inputs on
+    // A8-A15: set AXES_PCINT_VECTORS to 0b100):
+    // { 'A',  31,  32,  33, 62,     63,     { 400.0f,  50.0f,  10,       false,   true,  0.0f }, {}, {} }, // rotation
+    // { 'F',  34,  35,  36, 64,     NO_PIN, { 200.0f,  20.0f, 400,       false,   true,  0.5f }, {}, {} }, // fine focus
+    // Same X row with an encoder (A/B on A12/A13, 400-line disc, 1/16 microstepping,
+    // 20-step tolerance; AXES_PCINT_VECTORS 0b100 too):        pinA pinB counts/rev steps/rev stallSteps
+    // { 'X',   7,   6,   5,  2,      3,     { 800.0f, 100.0f, 100,       true,    true,  2.0f }, { 66, 67, 1600, 3200, 20 }, {} },
+    // Y with MS1-MS3 on 37/38/39: 1/16 for positioning, 1/2 above 200 steps/s
+    // (maxSpeed and stepsPerUnit then count 1/16 steps):
+    //                                                                                      ms1 ms2 ms3 fine coarse coarseSpeed
+    // { 'Y',  25,  26,  27, 18,     19,     { 2400.0f, 64.0f, 64,       false,   true,  2.0f }, {}, { 37, 38, 39, 16, 2, 200 } },
+};
+
+constexpr uint8_t AXIS_COUNT = sizeof(AXES_CONFIG) / sizeof(AXES_CONFIG[0]);
+
+// Pin-change vectors the firmware defines, bit n for PCINTn_vect: PCINT0 =
+// 10-13, 50-53; PCINT1 = 14, 15; PCINT2 = A8-A15. A group left out stays
+// free for another library (SoftwareSerial, PinChangeInterrupt); a limit or
+// encoder pin in it fails the build (see StepperMotors.cpp).
+#ifndef AXES_PCINT_VECTORS
+#define AXES_PCINT_VECTORS 0b000    // the table above uses external interrupts only
+#endif
+
+#endif /* AXESCONFIG_H_ */
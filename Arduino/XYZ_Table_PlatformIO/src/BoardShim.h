@@ -0,0 +1,87 @@
+/**
+ * ===============================================================
+ *  BoardShim.h
+ *  XYZ Camera Positioning System - AVR Runtime Hooks
+ * ===============================================================
+ *  Description:
+ *  - The few places where the firmware reaches past the Arduino core
+ *    into the AVR runtime: code run at reset, the watchdog reboot,
+ *    .noinit RAM, direct port writes and the linker's memory map.
+ *  - The host emulator (emulator/) builds the same sources with
+ *    ARDUINO_EMULATOR defined; this is the only header that tells the
+ *    two apart, so no other source carries an emulator branch.
+ * ===============================================================
+ */
+
+#ifndef BOARDSHIM_H_
+#define BOARDSHIM_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include <avr/wdt.h>
+
+#ifndef ARDUINO_EMULATOR
+
+// Defines fn to run from .init3, before the C runtime initialization: no
+// stack frame and no initialized data yet.
+#define BOARD_EARLY_INIT(fn) \
+	void fn(void) __attribute__((naked, used, section(".init3"))); \
+	void fn(void)
+
+// The avr-libc linker symbols, .init sections and malloc free list the
+// memory diagnostics read (see MegaBoard::MemCallback).
+#define BOARD_MEMORY_MAP 1
+
+// .noinit RAM survives a reset by itself.
+inline void BoardKeepNoinit(void *data, size_t size)
+{
+	(void)data;
+	(void)size;
+}
+
+// Resets through the watchdog, so every peripheral starts from its reset
+// state. RAM is kept.
+inline void BoardReset(void)
+{
+	wdt_enable(WDTO_15MS);
+	for (;;) {
+	}
+}
+
+inline void BoardWritePin(volatile uint8_t *reg, uint8_t mask, uint8_t pin, bool high)
+{
+	(void)pin;
+	if (high) *reg |= mask;
+	else      *reg &= ~mask;
+}
+
+#else
+
+// Run at each emulated reset, once MCUSR is set and before setup().
+#define BOARD_EARLY_INIT(fn) \
+	static void fn(void); \
+	static const bool fn##AtReset __attribute__((unused)) = EmulatorAtReset(fn); \
+	static void fn(void)
+
+#define BOARD_MEMORY_MAP 0
+
+// The emulator re-executes itself on a reset and carries the registered
+// objects over.
+inline void BoardKeepNoinit(void *data, size_t size) { EmulatorKeepNoinit(data, size); }
+inline void BoardReset(void)                         { EmulatorReboot(); }
+
+// The emulator only sees digitalWrite().
+inline void BoardWritePin(volatile uint8_t *reg, uint8_t mask, uint8_t pin, bool high)
+{
+	(void)reg;
+	(void)mask;
+	digitalWrite(pin, high ? HIGH : LOW);
+}
+
+#endif
+
+#endif /* BOARDSHIM_H_ */
@@ -35,14 +35,27 @@ void CLIService::Init() {
 	aCmdLine.CmdAdd("version", Version); // Prints firmware version
 	aCmdLine.CmdAdd("reboot", Reboot);   // Restarts the system
 	aCmdLine.CmdAdd("ram", Ram);         // Displays free RAM in bytes
+	aCmdLine.CmdAdd("mem", Mem);         // Static/heap/stack audit with high-water mark
+	aCmdLine.CmdAdd("events", Events);   // Dumps / clears the event recorder
+	aCmdLine.CmdAdd("ping", Ping);       // Echo + receive/dispatch timestamps
+	aCmdLine.CmdAdd("baud", Baud);       // Negotiate a faster serial link
 
 	/* Stepper Configuration Command */
 	aCmdLine.CmdAdd("axe", Axe);         // Modify axis settings (speed, accel, etc.)
+	aCmdLine.CmdAdd("limits", Limits);   // Limit trips and ISR-to-last-step latency
+	aCmdLine.CmdAdd("status", Status);   // Compact state of every axis
 
 	/* Motion Commands */
 	aCmdLine.CmdAdd("move", MoveSingle); // Relative move
 	aCmdLine.CmdAdd("run", Run);         // Continuous move
 	aCmdLine.CmdAdd("stop", Stop);       // Stop axes
+	aCmdLine.CmdAdd("zstack", ZStack);   // Focus stack: step, settle, trigger
+	aCmdLine.CmdAdd("track", Track);     // Follow streamed absolute setpoints
+	aCmdLine.CmdAdd("at", At);           // Run a command at a firmware-clock time
+	aCmdLine.CmdAdd("blk", Blk);         // Queue/play host-compiled step blocks
+	aCmdLine.CmdAdd("rec", Rec);         // Record run/stop/speed of a jog session
+	aCmdLine.CmdAdd("replay", Replay);   // Replay it, scaled and/or looped
+	aCmdLine.CmdAdd("strobe", Strobe);   // Latch positions on camera strobe edges
 
 	aCmdLine.CmdInit(); // Finalize registration
 }
@@ -50,6 +63,7 @@ void CLIService::Init() {
 // Poll serial input for commands
 void CLIService::Loop() {
 	aCmdLine.CmdPoll(); // Process any new command from serial
+	MegaBoard::BaudLoop(); // Apply or fall back from a 'baud' switch
 }
 
 // Print command-line prompt (e.g., '>')
@@ -74,11 +88,41 @@ void CLIService::Ram(int arg_cnt, char **args) {
 	MegaBoard::Println(String(MegaBoard::FreeRam()));
 }
 
+// System command: SRAM audit (static footprint, heap free list, stack high-water)
+void CLIService::Mem(int arg_cnt, char **args) {
+	MegaBoard::MemCallback(arg_cnt, args);
+}
+
+// System command: dump or clear the flight recorder
+void CLIService::Events(int arg_cnt, char **args) {
+	EventLog::EventsCallback(arg_cnt, args);
+}
+
+// System command: latency probe (host tokens echoed with firmware timestamps)
+void CLIService::Ping(int arg_cnt, char **args) {
+	ControlService::PingCallback(arg_cnt, args);
+}
+
+// System command: switch the serial link rate, with fallback and CRC check
+void CLIService::Baud(int arg_cnt, char **args) {
+	MegaBoard::BaudCallback(arg_cnt, args);
+}
+
 /* Stepper motor configuration command */
 void CLIService::Axe(int arg_cnt, char **args) {
 	StepperMotors::axisCallback(arg_cnt, args);
 }
 
+/* Limit switch diagnostics: trips and STEP pulses emitted after the ISR */
+void CLIService::Limits(int arg_cnt, char **args) {
+	StepperMotors::limitsCallback(arg_cnt, args);
+}
+
+/* Compact one-line state of all axes and the FSM (for host polling) */
+void CLIService::Status(int arg_cnt, char **args) {
+	ControlService::StatusCallback(arg_cnt, args);
+}
+
 /* Motion command: move stepper(s) to a relative position */
 void CLIService::MoveSingle(int arg_cnt, char **args) {
 	ControlService::MoveCallback(arg_cnt, args);
@@ -93,3 +137,38 @@ void CLIService::Run(int arg_cnt, char **args) {
 void CLIService::Stop(int arg_cnt, char **args) {
 	ControlService::StopCallback(arg_cnt, args);
 }
+
+/* Acquisition command: focus stack on the focus axis */
+void CLIService::ZStack(int arg_cnt, char **args) {
+	ControlService::ZStackCallback(arg_cnt, args);
+}
+
+/* Motion command: follow absolute setpoints streamed by the host */
+void CLIService::Track(int arg_cnt, char **args) {
+	ControlService::TrackCallback(arg_cnt, args);
+}
+
+/* Motion command: queue any command for a time on the firmware clock */
+void CLIService::At(int arg_cnt, char **args) {
+	ControlService::AtCallback(arg_cnt, args);
+}
+
+/* Motion command: stream and play back step blocks compiled on the host */
+void CLIService::Blk(int arg_cnt, char **args) {
+	ControlService::BlkCallback(arg_cnt, args);
+}
+
+/* Motion command: record the run/stop/speed commands of a jog session */
+void CLIService::Rec(int arg_cnt, char **args) {
+	JogRecorder::RecCallback(arg_cnt, args);
+}
+
+/* Motion command: replay the recorded jog session */
+void CLIService::Replay(int arg_cnt, char **args) {
+	ControlService::ReplayCallback(arg_cnt, args);
+}
+
+/* Motion command: stream the positions latched by the camera strobe */
+void CLIService::Strobe(int arg_cnt, char **args) {
+	::Strobe::StrobeCallback(arg_cnt, args);
+}
@@ -27,6 +27,7 @@
 #include "MegaBoard.h"
 #include "ControlService.h"
 #include "StepperMotors.h"
+#include "EventLog.h"
 
 class CLIService {
 public:
@@ -45,14 +46,27 @@ private:
 	static void Version(int arg_cnt, char **args); // Print firmware version
 	static void Reboot(int arg_cnt, char **args);  // Reboot the device
 	static void Ram(int arg_cnt, char **args);     // Report free RAM
+	static void Mem(int arg_cnt, char **args);     // SRAM audit: static, heap, stack
+	static void Events(int arg_cnt, char **args);  // Dump the flight recorder
+	static void Ping(int arg_cnt, char **args);    // Latency probe with firmware timestamps
+	static void Baud(int arg_cnt, char **args);    // Serial link rate negotiation
 
 	// Stepper configuration command
 	static void Axe(int arg_cnt, char **args);     // Configure axis settings
+	static void Limits(int arg_cnt, char **args);  // Report limit-stop latency
+	static void Status(int arg_cnt, char **args);  // All axes + FSM in one line
 
 	// Motion control commands
 	static void MoveSingle(int arg_cnt, char **args); // Move command
 	static void Run(int arg_cnt, char **args);        // Continuous movement
 	static void Stop(int arg_cnt, char **args);       // Stop motion
+	static void ZStack(int arg_cnt, char **args);     // Focus-stack acquisition
+	static void Track(int arg_cnt, char **args);      // Streaming setpoints
+	static void At(int arg_cnt, char **args);         // Queue a command on the firmware clock
+	static void Blk(int arg_cnt, char **args);        // Host-compiled step blocks
+	static void Rec(int arg_cnt, char **args);        // Record a jog session
+	static void Replay(int arg_cnt, char **args);     // Replay the recorded jog session
+	static void Strobe(int arg_cnt, char **args);     // Position-latched camera strobe
 };
 
 #endif /* CLISERVICE_H_ */
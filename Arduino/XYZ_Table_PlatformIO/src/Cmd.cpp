@@ -5,6 +5,7 @@
    - buffer overflow guard in cmd_handler default case
    - argv off-by-one fix in cmd_parse
    - removed '.' recall-last-command feature (conflicted with decimal numbers)
+   - ';'-separated batches, run in one pass with a single reply
  *******************************************************************/
 #include <avr/pgmspace.h>
 #if ARDUINO >= 100
@@ -13,10 +14,19 @@
 #include <WProgram.h>
 #endif
 #include "Cmd.h"
+#include "EventLog.h"
+#include "MegaBoard.h"
 
 const char cmd_prompt[]  PROGMEM = ">";
 const char cmd_unrecog[] PROGMEM = "Command not recognized.";
 
+uint32_t Cmd::rx_us       = 0;
+uint32_t Cmd::dispatch_us = 0;
+Cmd     *Cmd::instance    = NULL;
+bool     Cmd::refused     = false;
+void   (*Cmd::batchBegin)(void) = NULL;
+void   (*Cmd::batchAbort)(void) = NULL;
+
 Cmd::Cmd()
 {
     msg_ptr      = msg;
@@ -44,20 +54,20 @@ void Cmd::cmd_display()
     CMD_SERIAL.print(buf);
 }
 
-void Cmd::cmd_parse(char *cmd)
+_cmd_t *Cmd::cmd_find(const char *name, size_t len)
+{
+    for (_cmd_t *entry = cmd_tbl; entry != NULL; entry = entry->next) {
+        if (!strncmp(name, entry->cmd, len) && entry->cmd[len] == '\0')
+            return entry;
+    }
+    return NULL;
+}
+
+void Cmd::cmd_exec(char *cmd, _cmd_t *entry)
 {
     uint8_t argc;
     uint8_t i = 0;
     char   *argv[30];
-    char    buf[50];
-    _cmd_t *cmd_entry;
-
-    fflush(stdout);
-
-    if (cmd[0] == '\0')
-        goto unrecognized;
-
-    strcpy(last_cmd, cmd);
 
     // Tokenize — write argv[0..28] at most (argv has 30 slots, indices 0-29).
     // Check the bound BEFORE writing to avoid the off-by-one overrun.
@@ -69,14 +79,96 @@ void Cmd::cmd_parse(char *cmd)
     }
     argc = i;  // number of valid tokens (argv[0..argc-1] are non-NULL)
 
-    for (cmd_entry = cmd_tbl; cmd_entry != NULL; cmd_entry = cmd_entry->next) {
-        if (!strcmp(argv[0], cmd_entry->cmd)) {
-            cmd_entry->func(argc, argv);
-            cmd_display();
+    EventLog::RecordCommand(argv[0]);
+    dispatch_us = micros();
+    entry->func(argc, argv);
+}
+
+// "run x; run -y; axe z maxSpeed=600": every command name is looked up before
+// any of them runs, then all run back to back in this pass, so the axes they
+// start take their first steps in the same StepperMotors::runAll(). The
+// replies share one ETX. Arguments are only checked as each command runs: one
+// that refuses them ends the batch there, and the axes the earlier commands
+// set moving are stopped again. Settings they changed stay changed.
+void Cmd::cmd_batch(char *line)
+{
+    char   *part[MAX_BATCH];
+    uint8_t n = 0;
+
+    for (char *p = line; p != NULL; ) {
+        char *end = strchr(p, ';');
+        if (end)
+            *end++ = '\0';
+        while (*p == ' ')
+            p++;
+        if (*p) {
+            if (n == MAX_BATCH) {
+                MegaBoard::Println(F("[Batch] Too many commands, nothing run."));
+                return;
+            }
+            part[n++] = p;
+        }
+        p = end;
+    }
+
+    _cmd_t *entry[MAX_BATCH];
+    for (uint8_t i = 0; i < n; i++) {
+        size_t len = strcspn(part[i], " ");
+        entry[i] = cmd_find(part[i], len);
+        if (entry[i] == NULL) {
+            part[i][len] = '\0';
+            MegaBoard::Print(F("[Batch] Command not recognized: "));
+            MegaBoard::Print(part[i]);
+            MegaBoard::Println(F(", nothing run."));
             return;
         }
     }
 
+    if (batchBegin)
+        batchBegin();
+    MegaBoard::HoldReplies();
+    for (uint8_t i = 0; i < n; i++) {
+        refused = false;
+        cmd_exec(part[i], entry[i]);
+        if (refused) {
+            if (batchAbort)
+                batchAbort();
+            MegaBoard::Print(F("[Batch] "));
+            MegaBoard::Print(part[i]);
+            MegaBoard::Println(F(" refused: the rest not run, the axes started before it stopped."));
+            break;
+        }
+    }
+    MegaBoard::EndReply();
+}
+
+void Cmd::cmd_parse(char *cmd)
+{
+    char    buf[50];
+    _cmd_t *cmd_entry;
+
+    fflush(stdout);
+
+    while (*cmd == ' ')
+        cmd++;
+    if (cmd[0] == '\0')
+        goto unrecognized;
+
+    strcpy(last_cmd, cmd);
+
+    if (strchr(cmd, ';')) {
+        cmd_batch(cmd);
+        cmd_display();
+        return;
+    }
+
+    cmd_entry = cmd_find(cmd, strcspn(cmd, " "));
+    if (cmd_entry != NULL) {
+        cmd_exec(cmd, cmd_entry);
+        cmd_display();
+        return;
+    }
+
 unrecognized:
     strcpy_P(buf, cmd_unrecog);
     CMD_SERIAL.print(buf);
@@ -106,6 +198,8 @@ void Cmd::cmd_handler()
     default:
         // Guard against buffer overflow — leave room for the null terminator.
         // '.' is treated as a regular character (decimal numbers in commands).
+        if (msg_ptr == msg)
+            rx_us = micros();
         if (msg_ptr < msg + MAX_MSG_SIZE - 1) {
             CMD_SERIAL.print(c);
             *msg_ptr++ = c;
@@ -116,7 +210,30 @@ void Cmd::cmd_handler()
 
 void Cmd::CmdInit()
 {
-    msg_ptr = msg;
+    msg_ptr  = msg;
+    instance = this;
+}
+
+bool Cmd::Known(const char *name)
+{
+    return instance && instance->cmd_find(name, strlen(name)) != NULL;
+}
+
+void Cmd::Execute(char *line, uint32_t rxUs)
+{
+    while (*line == ' ')
+        line++;
+    _cmd_t *entry = instance ? instance->cmd_find(line, strcspn(line, " ")) : NULL;
+    if (entry == NULL)
+        return;
+    rx_us = rxUs;
+    instance->cmd_exec(line, entry);
+}
+
+void Cmd::DiscardLine()
+{
+    if (instance)
+        instance->msg_ptr = instance->msg;
 }
 
 void Cmd::CmdPoll()
@@ -10,6 +10,7 @@
 #endif
 
 #define MAX_MSG_SIZE 180
+#define MAX_BATCH    8      // commands per ';'-separated line
 
 #include <stdint.h>
 
@@ -32,13 +33,38 @@ public:
     static void Print(String rText);
     static void PrintPrompt(void);
 
+    // micros() when the first byte of the current command line was read and
+    // when its handler was called (latency tracing: ping, run t=<id>).
+    static uint32_t RxMicros(void) { return rx_us; }
+    static uint32_t DispatchMicros(void) { return dispatch_us; }
+
+    // For commands run later from the firmware (ControlService 'at' queue).
+    static bool Known(const char *name);
+    static void Execute(char *line, uint32_t rxUs);   // one command, no echo or prompt
+    static void DiscardLine(void);                    // drop the half-received line (e-stop)
+
+    // Batches (see cmd_batch): a handler that turns its arguments down calls
+    // Refuse(). The commands after it are skipped and `abort` undoes what the
+    // ones before it started, from the state `begin` noted.
+    static void Refuse(void) { refused = true; }
+    static void OnBatch(void (*begin)(void), void (*abort)(void)) { batchBegin = begin; batchAbort = abort; }
+
 private:
     char  msg[MAX_MSG_SIZE];
     char  last_cmd[MAX_MSG_SIZE] = {0};
     char *msg_ptr;                        // fixed: was uint8_t* (type mismatch)
     _cmd_t *cmd_tbl_list, *cmd_tbl;
+    static uint32_t rx_us;
+    static uint32_t dispatch_us;
+    static Cmd     *instance;             // the registered command table
+    static bool     refused;              // set by the running handler, see Refuse()
+    static void   (*batchBegin)(void);
+    static void   (*batchAbort)(void);
 
     void cmd_parse(char *cmd);
+    void cmd_batch(char *line);
+    void cmd_exec(char *cmd, _cmd_t *entry);
+    _cmd_t *cmd_find(const char *name, size_t len);
     void cmd_handler();
     static void cmd_display();
 };
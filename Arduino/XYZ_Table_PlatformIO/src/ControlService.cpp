@@ -14,16 +14,82 @@
 
 StepperMotors ControlService::motors;
 ControlService::FSMState ControlService::aState = ControlService::FSMState::IDLE;
+ControlService::ZStack ControlService::aZStack = {
+    0, 0, 0, 0, 0, 0, ZSTACK_DEFAULT_SETTLE_MS, ControlService::ZStackPhase::MOVING, 0
+};
+ControlService::Replay ControlService::aReplay;
+ControlService::AtEntry ControlService::aAtQueue[AT_SLOTS];
+uint8_t  ControlService::aAtCount  = 0;
+uint16_t ControlService::aAtNextId = 1;
+uint8_t  ControlService::aBatchIdle = 0;
+ControlService::FSMState ControlService::aBatchState = ControlService::FSMState::IDLE;
 
 ControlService::ControlService() {}
 
+// Every FSM transition goes through here so the flight recorder sees it.
+void ControlService::setState(FSMState state)
+{
+    if (state != aState)
+        EventLog::Record(EV_FSM, EVENT_NO_AXIS, (int32_t)state);
+    aState = state;
+}
+
+const __FlashStringHelper *ControlService::stateName(FSMState state)
+{
+    switch (state) {
+    case FSMState::IDLE:              return F("IDLE");
+    case FSMState::MOVING_CONTINUOUS: return F("RUN");
+    case FSMState::MOVING_STEPS:      return F("MOVE");
+    case FSMState::ZSTACK:            return F("ZSTACK");
+    case FSMState::TRACKING:          return F("TRACK");
+    case FSMState::BLOCKS:            return F("BLOCKS");
+    case FSMState::REPLAY:            return F("REPLAY");
+    }
+    return F("?");
+}
+
 void ControlService::Begin()
 {
+    pinMode(ZSTACK_TRIGGER_PIN, OUTPUT);
+    digitalWrite(ZSTACK_TRIGGER_PIN, LOW);
     disableMotors();
+    MegaBoard::OnEmergencyStop(StepperMotors::handleEmergencyStop);
+    Cmd::OnBatch(batchBegin, batchAbort);
+    restorePositions();
+    StepBlocks::Begin(&motors);
+    JogRecorder::Begin(&motors);
+    Strobe::Begin(&motors);
+}
+
+// Positions kept across the reset (see WarmStart), reported as
+// ^RESTORE [ram|eeprom X=... Y=...]; a '*' marks an axis that was moving,
+// whose position may be off by up to one checkpoint period of travel.
+void ControlService::restorePositions()
+{
+    WarmSource source = WarmStart::Source();
+    if (source == WarmSource::NONE)
+        return;
+
+    String report = (source == WarmSource::RAM) ? "^RESTORE [ram" : "^RESTORE [eeprom";
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        const AxisSnapshot &snap = WarmStart::Restored(i);
+        motors.restore(i, snap, source == WarmSource::EEPROM);
+        report += " " + String(StepperMotors::axisName(i)) + "=" +
+                  StepperMotors::formatMu(motors.stepsToMu(i, snap.steps));
+        if (snap.flags & WARM_MOVING)
+            report += "*";
+    }
+    MegaBoard::Println(report + "]");
+    EventLog::Record(EV_RESTORE, EVENT_NO_AXIS, (int32_t)source);
 }
 
 void ControlService::Loop()
 {
+    if (motors.emergencyStopPending())
+        emergencyStop();
+    atLoop();
+    StepBlocks::Loop();
+    Strobe::Loop();
     motors.runAll();
 
     switch (aState) {
@@ -37,36 +103,313 @@ void ControlService::Loop()
         break;
 
     case FSMState::MOVING_STEPS:
-        if (!motors.isRunning(StepperMotors::X) &&
-            !motors.isRunning(StepperMotors::Y) &&
-            !motors.isRunning(StepperMotors::Z)) {
+        if (!motors.isAnyRunning()) {
             disableMotors();
-            aState = FSMState::IDLE;
+            setState(FSMState::IDLE);
             MegaBoard::Println("^FSM [Move complete]");
         }
         break;
+
+    case FSMState::ZSTACK:
+        zstackLoop();
+        break;
+
+    case FSMState::TRACKING:
+        // Motors stay enabled between setpoints; only leave once every
+        // tracked axis has ramped down after 'track stop'.
+        if (!motors.isAnyRunning()) {
+            disableMotors();
+            setState(FSMState::IDLE);
+            MegaBoard::Println("^FSM [Tracking ended]");
+        }
+        break;
+
+    case FSMState::BLOCKS:
+        blocksLoop();
+        break;
+
+    case FSMState::REPLAY:
+        replayLoop();
+        break;
+    }
+
+    WarmStart::Loop(motors);
+}
+
+// The e-stop byte has already halted the axes, cut the drivers and dropped
+// the buffered input from the serial receive interrupt. Here the state is
+// settled as a 'stop' would, and the half-received line and the scheduled
+// commands are dropped too, so nothing starts again by itself.
+void ControlService::emergencyStop()
+{
+    Cmd::DiscardLine();
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        JogRecorder::Stop(i);   // a recording must not leave an axis running
+    uint32_t us = motors.serviceEmergencyStop();
+    StepBlocks::Clear();
+    aAtCount = 0;
+    if (aState == FSMState::REPLAY)
+        replayRestore();
+    if (aState == FSMState::ZSTACK)
+        digitalWrite(ZSTACK_TRIGGER_PIN, LOW);
+    setState(FSMState::IDLE);
+
+    MegaBoard::Println("^ESTOP [Motors halted and disabled, serviced after " + String(us) + " us]");
+}
+
+// Commands whose time has come run here, before runAll(), so the axes they
+// start step in this same pass. Each one is reported as a single event frame:
+// ^AT [id=N late=Tus] followed by the command's own reply lines.
+void ControlService::atLoop()
+{
+    while (aAtCount && (int32_t)(micros() - aAtQueue[0].atUs) >= 0) {
+        AtEntry e = aAtQueue[0];
+        aAtCount--;
+        memmove(&aAtQueue[0], &aAtQueue[1], aAtCount * sizeof(AtEntry));
+
+        MegaBoard::Print(F("^AT [id="));
+        MegaBoard::Print(e.id);
+        MegaBoard::Print(F(" late="));
+        MegaBoard::Print(micros() - e.atUs);
+        MegaBoard::Print(F("us]"));
+        MegaBoard::Println();
+        MegaBoard::HoldReplies();
+        Cmd::Execute(e.line, e.atUs);
+        MegaBoard::EndReply();
+    }
+}
+
+// One slice = move focus axis → wait until stopped + settle → trigger HIGH for
+// dwellMs → next slice. Runs entirely on the firmware clock, no host round trip.
+void ControlService::zstackLoop()
+{
+    ZStack  &zs  = aZStack;
+    uint32_t now = millis();
+
+    if (motors.isRetracting(zs.axis)) {
+        zstackEnd("aborted, limit switch");
+        return;
+    }
+
+    switch (zs.phase) {
+    case ZStackPhase::MOVING:
+        if (!motors.isRunning(zs.axis)) {
+            zs.phase        = ZStackPhase::SETTLING;
+            zs.phaseStartMs = now;
+        }
+        break;
+
+    case ZStackPhase::SETTLING:
+        if (now - zs.phaseStartMs >= zs.settleMs) {
+            digitalWrite(ZSTACK_TRIGGER_PIN, HIGH);
+            zs.phase        = ZStackPhase::EXPOSING;
+            zs.phaseStartMs = now;
+
+            MegaBoard::Print("^ZSTACK [slice ");
+            MegaBoard::Print(zs.index + 1);
+            MegaBoard::Print("/");
+            MegaBoard::Print(zs.count);
+            MegaBoard::Println("]");
+        }
+        break;
+
+    case ZStackPhase::EXPOSING:
+        if (now - zs.phaseStartMs >= zs.dwellMs) {
+            digitalWrite(ZSTACK_TRIGGER_PIN, LOW);
+            if (++zs.index >= zs.count) {
+                zstackEnd("complete");
+                return;
+            }
+            motors.moveTo(zs.axis, zs.start + zs.step * zs.index);
+            zs.phase = ZStackPhase::MOVING;
+        }
+        break;
+    }
+}
+
+void ControlService::zstackEnd(const char *reason)
+{
+    digitalWrite(ZSTACK_TRIGGER_PIN, LOW);
+    disableMotors();
+    setState(FSMState::IDLE);
+    MegaBoard::Print("^ZSTACK [");
+    MegaBoard::Print(reason);
+    MegaBoard::Println("]");
+}
+
+// Playback has ended on its own: ^BLK [done ...] once the buffer ran empty
+// after 'blk end', ^BLK [underrun ...] if it ran empty before. A limit trip
+// leaves the retract running; MOVING_STEPS disables the motors after it.
+void ControlService::blocksLoop()
+{
+    if (StepBlocks::Playing())
+        return;
+
+    BlockState end    = StepBlocks::State();
+    uint16_t   played = StepBlocks::Played();
+    StepBlocks::Clear();
+
+    if (end == BlockState::HALTED) {
+        setState(FSMState::MOVING_STEPS);
+        MegaBoard::Println("^BLK [halted by limit after " + String(played) + " blocks]");
+        return;
+    }
+
+    disableMotors();
+    setState(FSMState::IDLE);
+    if (end == BlockState::DONE)
+        MegaBoard::Println("^BLK [done played=" + String(played) + "]");
+    else
+        MegaBoard::Println("^BLK [underrun after " + String(played) + " blocks]");
+}
+
+// Step-block playback and jog replay own the axes until they end or 'stop'.
+bool ControlService::axesBusy(const char *tag)
+{
+    if (aState != FSMState::BLOCKS && aState != FSMState::REPLAY)
+        return false;
+    Cmd::Refuse();
+    MegaBoard::Print(tag);
+    MegaBoard::Print(' ');
+    MegaBoard::Print(stateName(aState));
+    MegaBoard::Println(F(" in progress, use 'stop' first."));
+    return true;
+}
+
+void ControlService::batchBegin()
+{
+    aBatchIdle = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        if (!motors.isRunning(i))
+            aBatchIdle |= _BV(i);
+    aBatchState = aState;
+}
+
+// Axes that stood still when the batch began and move now are stopped, and
+// the state goes back to what it was, leaving it as a 'stop' would.
+void ControlService::batchAbort()
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if ((aBatchIdle & _BV(i)) && motors.isRunning(i)) {
+            motors.stop(i);
+            JogRecorder::Stop(i);
+        }
+    }
+    if (aState == aBatchState)
+        return;
+    if (aState == FSMState::BLOCKS)
+        StepBlocks::Clear();
+    if (aState == FSMState::REPLAY)
+        replayRestore();
+    if (aState == FSMState::ZSTACK)
+        digitalWrite(ZSTACK_TRIGGER_PIN, LOW);
+    setState(aBatchState);
+}
+
+// Every pass starts from the recorded start positions, reached at the
+// normal speed settings; the recorded clock only runs once they are.
+void ControlService::replayPosition()
+{
+    replayRestore();
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        motors.moveTo(i, motors.stepsToMu(i, JogRecorder::StartSteps(i)));
+    aReplay.positioning = true;
+    aReplay.next        = 0;
+}
+
+// The recorded commands run at their time divided by the speed factor,
+// with maxSpeed scaled by it and the acceleration by its square, so the
+// axes follow the recorded path. A stop moves to the recorded rest
+// position, so every leg ends on the same step as in the recording.
+void ControlService::replayLoop()
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if (motors.isRetracting(i)) {
+            replayRestore();
+            setState(FSMState::MOVING_STEPS);
+            MegaBoard::Println("^REPLAY [halted by limit]");
+            return;
+        }
+    }
+
+    float scale = aReplay.scale;
+    if (aReplay.positioning) {
+        if (motors.isAnyRunning())
+            return;
+        for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+            motors.setMaxSpeed(i, JogRecorder::StartSpeed(i) * scale);
+            motors.setAcceleration(i, JogRecorder::StartAcceleration(i) * scale * scale);
+        }
+        aReplay.positioning = false;
+        aReplay.startMs     = millis();
+        MegaBoard::Println("^REPLAY [pass " + String(aReplay.pass) + "]");
+        return;
+    }
+
+    float elapsed = (millis() - aReplay.startMs) * scale;  // recording time, ms
+    while (aReplay.next < JogRecorder::Count() && JogRecorder::Event(aReplay.next).ms <= elapsed) {
+        const JogEvent &e = JogRecorder::Event(aReplay.next++);
+        switch (e.action) {
+        case JOG_RUN:
+            motors.moveRelative(e.axis, 100000L * MU_PER_UNIT * e.value);
+            break;
+        case JOG_STOP:
+            motors.moveTo(e.axis, motors.stepsToMu(e.axis, e.steps));
+            break;
+        case JOG_SPEED:
+            motors.setMaxSpeed(e.axis, e.value * scale);
+            break;
+        }
+    }
+
+    if (aReplay.next < JogRecorder::Count() || elapsed < JogRecorder::DurationMs() ||
+        motors.isAnyRunning())
+        return;
+    if (aReplay.loop) {
+        aReplay.pass++;
+        replayPosition();
+    } else {
+        replayEnd("done");
+    }
+}
+
+void ControlService::replayEnd(const char *reason)
+{
+    replayRestore();
+    disableMotors();
+    setState(FSMState::IDLE);
+    MegaBoard::Print("^REPLAY [");
+    MegaBoard::Print(reason);
+    MegaBoard::Println("]");
+}
+
+void ControlService::replayRestore()
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        motors.setMaxSpeed(i, aReplay.maxSpeed[i]);
+        motors.setAcceleration(i, aReplay.acceleration[i]);
     }
 }
 
 void ControlService::enableMotors()
 {
-    motors.setEnabled(StepperMotors::X, true);
-    motors.setEnabled(StepperMotors::Y, true);
-    motors.setEnabled(StepperMotors::Z, true);
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        motors.setEnabled(i, true);
 }
 
 void ControlService::disableMotors()
 {
-    motors.setEnabled(StepperMotors::X, false);
-    motors.setEnabled(StepperMotors::Y, false);
-    motors.setEnabled(StepperMotors::Z, false);
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        motors.setEnabled(i, false);
 }
 
 void ControlService::RunCallback(int arg_cnt, char **args)
 {
+    if (axesBusy("[Run]"))
+        return;
     if (arg_cnt < 2) {
-        MegaBoard::Println("[Run] Usage: run [x|y|z|all|-x|-y|-z|-all]");
-        disableMotors();
+        Cmd::Refuse();
+        MegaBoard::Println("[Run] Usage: run [-]<" + StepperMotors::axisList() + "|all> [t=<id>]");
         return;
     }
 
@@ -75,21 +418,34 @@ void ControlService::RunCallback(int arg_cnt, char **args)
 
     bool   reverse = rawArg.startsWith("-");
     String axis    = reverse ? rawArg.substring(1) : rawArg;
+    bool   all     = (axis == "all");
+    int    target  = StepperMotors::axisFromName(axis.c_str());
 
-    if (axis != "x" && axis != "y" && axis != "z" && axis != "all") {
-        MegaBoard::Println("[Run] Invalid argument. Usage: run [x|y|z|all|-x|-y|-z|-all]");
-        disableMotors();
+    if (!all && target < 0) {
+        Cmd::Refuse();
+        MegaBoard::Println("[Run] Invalid argument. Usage: run [-]<" + StepperMotors::axisList() + "|all> [t=<id>]");
         return;
     }
 
     int  dirSign = reverse ? -1 : 1;
-    long steps   = 100000L * dirSign;
+    long steps   = 100000L * MU_PER_UNIT * dirSign;
 
-    if (axis == "x" || axis == "all") { motors.setEnabled(StepperMotors::X, true); motors.moveRelative(StepperMotors::X, steps); }
-    if (axis == "y" || axis == "all") { motors.setEnabled(StepperMotors::Y, true); motors.moveRelative(StepperMotors::Y, steps); }
-    if (axis == "z" || axis == "all") { motors.setEnabled(StepperMotors::Z, true); motors.moveRelative(StepperMotors::Z, steps); }
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if (all || i == target) {
+            motors.setEnabled(i, true);
+            motors.moveRelative(i, steps);
+            JogRecorder::Run(i, dirSign);
+        }
+    }
 
-    aState = FSMState::MOVING_CONTINUOUS;
+    // Optional trace ID: ^TRACE reports when the first STEP edge went out.
+    for (int i = 2; i < arg_cnt; ++i) {
+        if (!strncmp(args[i], "t=", 2))
+            motors.traceFirstStep(all ? -1 : target, (uint16_t)atol(args[i] + 2),
+                                  Cmd::RxMicros(), Cmd::DispatchMicros());
+    }
+
+    setState(FSMState::MOVING_CONTINUOUS);
 
     MegaBoard::Print("[Run] Continuous motion ");
     MegaBoard::Print(reverse ? "reverse " : "forward ");
@@ -99,27 +455,41 @@ void ControlService::RunCallback(int arg_cnt, char **args)
 void ControlService::StopCallback(int arg_cnt, char **args)
 {
     String target = "all";
+    int    axis   = -1;
     if (arg_cnt > 1) {
         target = String(args[1]);
         target.toLowerCase();
-        if (target != "x" && target != "y" && target != "z" && target != "all") {
-            MegaBoard::Println("[Stop] Invalid argument. Usage: stop [x|y|z|all]");
+        axis = StepperMotors::axisFromName(target.c_str());
+        if (target != "all" && axis < 0) {
+            Cmd::Refuse();
+            MegaBoard::Println("[Stop] Invalid argument. Usage: stop [" + StepperMotors::axisList() + "|all]");
             return;
         }
     }
 
-    if (target == "x" || target == "all") motors.stop(StepperMotors::X);
-    if (target == "y" || target == "all") motors.stop(StepperMotors::Y);
-    if (target == "z" || target == "all") motors.stop(StepperMotors::Z);
+    // Nor can a focus stack: any stop aborts the whole of it.
+    if (aState == FSMState::ZSTACK)
+        target = "all";
+
+    bool all = (target == "all");
+    StepBlocks::Clear();    // a playback cannot lose one axis and stay on its path
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if (all || i == axis) {
+            motors.stop(i);
+            JogRecorder::Stop(i);
+        }
+    }
+    if (aState == FSMState::REPLAY)
+        replayRestore();
 
-    if (target == "all" ||
-        (!motors.isRunning(StepperMotors::X) &&
-         !motors.isRunning(StepperMotors::Y) &&
-         !motors.isRunning(StepperMotors::Z))) {
+    if (all || !motors.isAnyRunning()) {
         disableMotors();
     }
 
-    aState = FSMState::IDLE;
+    if (aState == FSMState::ZSTACK)
+        zstackEnd("aborted, stop");
+    else
+        setState(FSMState::IDLE);
 
     MegaBoard::Print("^STOP [Motors stopped for ");
     MegaBoard::Print(target);
@@ -128,8 +498,9 @@ void ControlService::StopCallback(int arg_cnt, char **args)
 
 void ControlService::MoveCallback(int arg_cnt, char **args)
 {
-    bool  shouldMoveX = false, shouldMoveY = false, shouldMoveZ = false;
-    float x = 0, y = 0, z = 0;
+    bool  shouldMove[AXIS_COUNT] = {false};
+    long  value[AXIS_COUNT]      = {0};   // mu
+    bool  anyAxis = false;
     bool  usedAll = false;
 
     for (int i = 1; i < arg_cnt - 1; i++) {
@@ -137,44 +508,470 @@ void ControlService::MoveCallback(int arg_cnt, char **args)
         arg.toLowerCase();
 
         if (arg == "all") {
-            float val = atof(args[++i]);
-            x = y = z = val;
-            shouldMoveX = shouldMoveY = shouldMoveZ = true;
-            usedAll = true;
+            long val = StepperMotors::parseMu(args[++i]);
+            for (uint8_t a = 0; a < AXIS_COUNT; ++a) {
+                value[a]      = val;
+                shouldMove[a] = true;
+            }
+            anyAxis = usedAll = true;
             break;
-        } else if (arg == "x") {
-            x = atof(args[++i]);
-            shouldMoveX = true;
-        } else if (arg == "y") {
-            y = atof(args[++i]);
-            shouldMoveY = true;
-        } else if (arg == "z") {
-            z = atof(args[++i]);
-            shouldMoveZ = true;
+        }
+
+        int axis = StepperMotors::axisFromName(arg.c_str());
+        if (axis >= 0) {
+            value[axis]      = StepperMotors::parseMu(args[++i]);
+            shouldMove[axis] = true;
+            anyAxis = true;
         }
     }
 
-    if (!shouldMoveX && !shouldMoveY && !shouldMoveZ) {
-        MegaBoard::Println("[Move] No valid axes. Usage: move X <val> Y <val> Z <val> | move all <val>");
+    if (!anyAxis) {
+        Cmd::Refuse();
+        MegaBoard::Println("[Move] No valid axes. Usage: move <axis> <val> [<axis> <val> ...] | move all <val>");
         return;
     }
+    if (axesBusy("[Move]"))
+        return;
 
     enableMotors();
 
-    if (shouldMoveX) motors.moveRelative(StepperMotors::X, x);
-    if (shouldMoveY) motors.moveRelative(StepperMotors::Y, y);
-    if (shouldMoveZ) motors.moveRelative(StepperMotors::Z, z);
+    for (uint8_t a = 0; a < AXIS_COUNT; ++a)
+        if (shouldMove[a]) motors.moveRelative(a, value[a]);
 
-    aState = FSMState::MOVING_STEPS;
+    setState(FSMState::MOVING_STEPS);
 
     MegaBoard::Print("[Move] Moving: ");
     if (usedAll) {
-        MegaBoard::Println("ALL=" + String(x));  // Println(value) → adds ETX ✓
+        MegaBoard::Println("ALL=" + StepperMotors::formatMu(value[0]));  // Println(value) → adds ETX ✓
     } else {
         String summary = "";
-        if (shouldMoveX) summary += "X=" + String(x) + " ";
-        if (shouldMoveY) summary += "Y=" + String(y) + " ";
-        if (shouldMoveZ) summary += "Z=" + String(z);
+        for (uint8_t a = 0; a < AXIS_COUNT; ++a) {
+            if (!shouldMove[a]) continue;
+            if (summary.length()) summary += " ";
+            summary += String(StepperMotors::axisName(a)) + "=" + StepperMotors::formatMu(value[a]);
+        }
         MegaBoard::Println(summary);             // Println(value) → adds ETX ✓
     }
 }
+
+bool ControlService::parseUint16(const char *text, uint16_t &value)
+{
+    char          *end;
+    unsigned long  parsed = strtoul(text, &end, 10);
+    if (!isdigit(*text) || *end || parsed > UINT16_MAX)
+        return false;
+    value = (uint16_t)parsed;
+    return true;
+}
+
+// Usage: zstack <start> <step> <count> [dwellMs] [settle=<ms>]
+//        zstack settle=<ms>     (only change the settle time)
+void ControlService::ZStackCallback(int arg_cnt, char **args)
+{
+    long     num[2]   = {0, 0};   // start, step: mu
+    uint16_t whole[2] = {0, 0};   // count, dwellMs: plain integers
+    uint8_t  numCnt   = 0;
+    bool     valid    = true;
+    ZStack   zs       = aZStack;
+
+    for (int i = 1; i < arg_cnt; i++) {
+        if (!strncmp(args[i], "settle=", 7)) {
+            valid &= parseUint16(args[i] + 7, zs.settleMs);
+        } else if (strchr(args[i], '=')) {
+            continue;
+        } else if (numCnt < 2) {
+            num[numCnt++] = StepperMotors::parseMu(args[i]);
+        } else if (numCnt < 4) {
+            valid &= parseUint16(args[i], whole[numCnt++ - 2]);
+        }
+    }
+
+    if (!valid) {
+        Cmd::Refuse();
+        MegaBoard::Println("[ZStack] Usage: zstack <start> <step> <count> [dwellMs] [settle=<ms>]");
+        return;
+    }
+
+    if (numCnt == 0 && arg_cnt > 1) {
+        aZStack.settleMs = zs.settleMs;
+        MegaBoard::Println("[ZStack] settle=" + String(zs.settleMs) + " ms");
+        return;
+    }
+
+    if (axesBusy("[ZStack]"))
+        return;
+
+    const char focus[] = { ZSTACK_FOCUS_AXIS, '\0' };
+    int axis = StepperMotors::axisFromName(focus);
+    if (numCnt < 3 || whole[0] == 0 || axis < 0) {
+        Cmd::Refuse();
+        MegaBoard::Println("[ZStack] Usage: zstack <start> <step> <count> [dwellMs] [settle=<ms>]");
+        return;
+    }
+
+    zs.axis         = axis;
+    zs.start        = num[0];
+    zs.step         = num[1];
+    zs.count        = whole[0];
+    zs.dwellMs      = whole[1];
+    zs.index        = 0;
+    zs.phase        = ZStackPhase::MOVING;
+    zs.phaseStartMs = millis();
+    aZStack = zs;
+
+    motors.setEnabled(zs.axis, true);
+    motors.moveTo(zs.axis, zs.start);
+    setState(FSMState::ZSTACK);
+
+    MegaBoard::Print("[ZStack] ");
+    MegaBoard::Print(StepperMotors::axisName(zs.axis));
+    MegaBoard::Println(" start=" + StepperMotors::formatMu(zs.start) + " step=" + StepperMotors::formatMu(zs.step) +
+                       " count=" + String(zs.count) + " dwell=" + String(zs.dwellMs) +
+                       " settle=" + String(zs.settleMs));
+}
+
+// Usage: track <axis> <pos> [<axis> <pos> ...]   absolute units, streamed at 30-100 Hz
+//        track stop                              ramp down and leave tracking
+// Replies with the following error (steps) of every tracked axis.
+void ControlService::TrackCallback(int arg_cnt, char **args)
+{
+    if (arg_cnt < 2) {
+        Cmd::Refuse();
+        MegaBoard::Println("[Track] Usage: track <axis> <pos> [<axis> <pos> ...] | track stop");
+        return;
+    }
+
+    String first = String(args[1]);
+    first.toLowerCase();
+    if (first == "stop") {
+        for (uint8_t a = 0; a < AXIS_COUNT; ++a)
+            motors.endTracking(a);
+        MegaBoard::Println("[Track] Stopping");
+        return;
+    }
+    if (axesBusy("[Track]"))
+        return;
+
+    bool anyAxis = false;
+    for (int i = 1; i < arg_cnt - 1; i += 2) {
+        int axis = StepperMotors::axisFromName(args[i]);
+        if (axis < 0 || motors.isRetracting(axis))
+            continue;
+        if (!motors.isTracking(axis))
+            motors.setEnabled(axis, true);
+        motors.trackTo(axis, StepperMotors::parseMu(args[i + 1]));
+        anyAxis = true;
+    }
+
+    if (!anyAxis) {
+        Cmd::Refuse();
+        MegaBoard::Println("[Track] No valid axes. Usage: track <axis> <pos> [<axis> <pos> ...] | track stop");
+        return;
+    }
+
+    setState(FSMState::TRACKING);
+
+    String reply = "[Track] err";
+    for (uint8_t a = 0; a < AXIS_COUNT; ++a) {
+        if (!motors.isTracking(a)) continue;
+        reply += " " + String(StepperMotors::axisName(a)) + "=" + String(motors.getFollowingError(a));
+    }
+    MegaBoard::Println(reply);
+}
+
+// ping [token...]: echoes the host's tokens (e.g. its send timestamp) with
+// the firmware clock at line receive, dispatch and reply, plus the last
+// closed run trace, so the host can split a round trip into hops.
+void ControlService::PingCallback(int arg_cnt, char **args)
+{
+    uint32_t rxUs       = Cmd::RxMicros();
+    uint32_t dispatchUs = Cmd::DispatchMicros();
+
+    MegaBoard::Print("[Ping]");
+    for (int i = 1; i < arg_cnt; ++i) {
+        MegaBoard::Print(" ");
+        MegaBoard::Print(args[i]);
+    }
+    MegaBoard::Print(" rx=");
+    MegaBoard::Print(rxUs);
+    MegaBoard::Print(" dispatch=");
+    MegaBoard::Print(dispatchUs);
+
+    const StepTrace &trace = motors.getTrace();
+    if (trace.id != 0 && !trace.pending) {
+        MegaBoard::Print(" trace=");
+        MegaBoard::Print(trace.id);
+        MegaBoard::Print(" step=");
+        MegaBoard::Print(trace.stepUs);
+    }
+
+    MegaBoard::Print(" now=");
+    MegaBoard::Println(micros());
+}
+
+// at <+us | us> <command ...>: queues one command on the firmware clock, either
+// relative to this line's arrival (+us) or at an absolute micros() value as
+// reported by `ping ... now=`. Commands due at the same time run in the same
+// pass, e.g. `at +500000 run x; at +500000 run -y`.
+// at list / at clear.
+void ControlService::AtCallback(int arg_cnt, char **args)
+{
+    if (arg_cnt == 2 && !strcmp(args[1], "clear")) {
+        aAtCount = 0;
+        MegaBoard::Println(F("[At] Queue cleared."));
+        return;
+    }
+    if (arg_cnt == 2 && !strcmp(args[1], "list")) {
+        uint32_t now = micros();
+        for (uint8_t i = 0; i < aAtCount; ++i) {
+            MegaBoard::Print(F("#"));
+            MegaBoard::Print(aAtQueue[i].id);
+            MegaBoard::Print(F(" t="));
+            MegaBoard::Print(aAtQueue[i].atUs);
+            MegaBoard::Print(F(" in="));
+            MegaBoard::Print((int32_t)(aAtQueue[i].atUs - now));
+            MegaBoard::Print(F("us "));
+            MegaBoard::Print(aAtQueue[i].line);
+            MegaBoard::Println();
+        }
+        MegaBoard::Print(F("[At] "));
+        MegaBoard::Print(aAtCount);
+        MegaBoard::Println(F(" queued"));
+        return;
+    }
+    if (arg_cnt < 3) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("Usage: at <+us|us> <command ...> | at list | at clear"));
+        return;
+    }
+
+    const char   *when  = args[1];
+    bool          rel   = (when[0] == '+');
+    unsigned long value = strtoul(rel ? when + 1 : when, NULL, 10);
+    uint32_t      atUs  = rel ? Cmd::RxMicros() + value : value;
+    if (value > 0xFFFFFFFFUL || (rel && value > AT_MAX_AHEAD_US) ||
+        (int32_t)(atUs - micros()) > (int32_t)AT_MAX_AHEAD_US) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[At] More than 30 min ahead."));
+        return;
+    }
+    if (!strcmp(args[2], "at") || !Cmd::Known(args[2])) {
+        Cmd::Refuse();
+        MegaBoard::Print(F("[At] Command not recognized: "));
+        MegaBoard::Println(args[2]);
+        return;
+    }
+    if (aAtCount == AT_SLOTS) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[At] Queue full."));
+        return;
+    }
+
+    AtEntry e;
+    e.atUs    = atUs;
+    e.line[0] = '\0';
+    for (int i = 2; i < arg_cnt; ++i) {
+        if (strlen(e.line) + strlen(args[i]) + 2 > AT_LINE_LEN) {
+            Cmd::Refuse();
+            MegaBoard::Println(F("[At] Command too long."));
+            return;
+        }
+        if (i > 2)
+            strcat(e.line, " ");
+        strcat(e.line, args[i]);
+    }
+    e.id = aAtNextId++;
+    if (aAtNextId == 0)
+        aAtNextId = 1;
+
+    // Keep the queue soonest first; equal times keep their arrival order.
+    uint8_t pos = aAtCount;
+    while (pos > 0 && (int32_t)(aAtQueue[pos - 1].atUs - atUs) > 0)
+        pos--;
+    memmove(&aAtQueue[pos + 1], &aAtQueue[pos], (aAtCount - pos) * sizeof(AtEntry));
+    aAtQueue[pos] = e;
+    aAtCount++;
+
+    MegaBoard::Print(F("[At] #"));
+    MegaBoard::Print(e.id);
+    MegaBoard::Print(F(" at t="));
+    MegaBoard::Print(atUs);
+    MegaBoard::Print(F(" (in "));
+    MegaBoard::Print((int32_t)(atUs - micros()));
+    MegaBoard::Println(F("us)"));
+}
+
+// Usage: blk <us> <steps> [<steps> ...]   queue a block: signed fine steps per axis
+//                                         (axis table order), spread evenly over <us>
+//        blk start                        play the queue; more blocks may follow
+//        blk end                          no more blocks follow
+//        blk clear                        stop playing and drop the queue
+//        blk                              queue state (JSON)
+// A queued block replies [Blk] free=<slots>, the host's flow control.
+void ControlService::BlkCallback(int arg_cnt, char **args)
+{
+    if (arg_cnt < 2) {
+        MegaBoard::Print(F("{\"state\":\""));
+        MegaBoard::Print(StepBlocks::StateName());
+        MegaBoard::Print(F("\",\"queued\":"));
+        MegaBoard::Print(StepBlocks::Queued());
+        MegaBoard::Print(F(",\"free\":"));
+        MegaBoard::Print(StepBlocks::Free());
+        MegaBoard::Print(F(",\"played\":"));
+        MegaBoard::Print(StepBlocks::Played());
+        MegaBoard::Print(F(",\"tickUs\":"));
+        MegaBoard::Print(BLOCK_TICK_US);
+        MegaBoard::Println('}');
+        return;
+    }
+
+    if (!strcmp(args[1], "start")) {
+        uint8_t queued = StepBlocks::Queued();
+        if (aState != FSMState::IDLE || motors.isAnyRunning()) {
+            Cmd::Refuse();
+            MegaBoard::Println(F("[Blk] Axes busy, not started."));
+        } else if (queued == 0) {
+            Cmd::Refuse();
+            MegaBoard::Println(F("[Blk] Nothing queued."));
+        } else {
+            enableMotors();
+            setState(FSMState::BLOCKS);
+            StepBlocks::Start();
+            MegaBoard::Println("[Blk] Playing " + String(queued) + " blocks");
+        }
+        return;
+    }
+    if (!strcmp(args[1], "end")) {
+        StepBlocks::End();
+        MegaBoard::Println("[Blk] End of stream, " + String(StepBlocks::Queued()) + " queued");
+        return;
+    }
+    if (!strcmp(args[1], "clear")) {
+        StepBlocks::Clear();
+        if (aState == FSMState::BLOCKS) {
+            disableMotors();
+            setState(FSMState::IDLE);
+        }
+        MegaBoard::Println(F("[Blk] Cleared."));
+        return;
+    }
+
+    char         *end;
+    unsigned long us    = strtoul(args[1], &end, 10);
+    unsigned long ticks = (us + BLOCK_TICK_US / 2) / BLOCK_TICK_US;
+    if (*end || ticks == 0 || ticks > BLOCK_MAX_TICKS || arg_cnt - 2 > AXIS_COUNT) {
+        Cmd::Refuse();
+        MegaBoard::Println("[Blk] Usage: blk <us> <steps " + StepperMotors::axisList() + "...> | blk start|end|clear");
+        return;
+    }
+
+    StepBlock block;
+    block.ticks = (uint16_t)ticks;
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        long steps = (i + 2 < arg_cnt) ? atol(args[i + 2]) : 0;
+        block.steps[i] = (int16_t)steps;
+        if (steps == 0)
+            continue;
+
+        String axis = String(StepperMotors::axisName(i));
+        if (2 * labs(steps) > (long)ticks) {
+            Cmd::Refuse();
+            MegaBoard::Println("[Blk] " + axis + " too fast: at most " + String(ticks / 2) + " steps in this block");
+            return;
+        }
+        if (motors.isRetracting(i) || !motors.insideSoftLimits(i, StepBlocks::Planned(i) + steps)) {
+            Cmd::Refuse();
+            MegaBoard::Println("[Blk] " + axis + " would leave the soft limits");
+            return;
+        }
+    }
+
+    if (!StepBlocks::Push(block)) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Blk] Full, free=0"));
+        return;
+    }
+    MegaBoard::Println("[Blk] free=" + String(StepBlocks::Free()));
+}
+
+// Usage: replay [x<factor>] [loop]   replay the 'rec' session, e.g. x0.5 at half speed;
+//                                   'loop' repeats it until 'stop'
+void ControlService::ReplayCallback(int arg_cnt, char **args)
+{
+    float scale = 1.0f;
+    bool  loop  = false;
+    for (int i = 1; i < arg_cnt; ++i) {
+        if (args[i][0] == 'x')
+            scale = atof(args[i] + 1);
+        else if (!strcmp(args[i], "loop"))
+            loop = true;
+        else
+            scale = 0.0f;
+    }
+    if (scale <= 0.0f || scale > REPLAY_MAX_SCALE) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Replay] Usage: replay [x<factor>] [loop], factor up to 4"));
+        return;
+    }
+    if (JogRecorder::Recording() || JogRecorder::Count() == 0) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Replay] Nothing recorded, use 'rec start' ... 'rec stop'."));
+        return;
+    }
+    if (aState != FSMState::IDLE || motors.isAnyRunning()) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Replay] Axes busy, not started."));
+        return;
+    }
+
+    aReplay.scale = scale;
+    aReplay.loop  = loop;
+    aReplay.pass  = 1;
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        MotorSettings m = motors.getMotorSettings(i);
+        aReplay.maxSpeed[i]     = m.maxSpeed;
+        aReplay.acceleration[i] = m.acceleration;
+    }
+    enableMotors();
+    setState(FSMState::REPLAY);
+    replayPosition();
+
+    MegaBoard::Println("[Replay] " + String(JogRecorder::Count()) + " events at x" + String(scale, 2) +
+                       (loop ? ", looped" : ""));
+}
+
+// status: every axis in one compact JSON line, printed piecewise (no String,
+// no heap). Per axis: [position steps, speed steps/s, distance to go,
+// enabled, min limit, max limit], plus the encoder's position error in
+// steps on an axis that has one.
+//   {"fsm":"RUN","ms":81234,"X":[1520,800,98480,1,0,0,-3],"Y":[0,0,0,0,0,0],...}
+void ControlService::StatusCallback(int arg_cnt, char **args)
+{
+    MegaBoard::Print(F("{\"fsm\":\""));
+    MegaBoard::Print(stateName(aState));
+    MegaBoard::Print(F("\",\"ms\":"));
+    MegaBoard::Print(millis());
+
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        MegaBoard::Print(F(",\""));
+        MegaBoard::Print(StepperMotors::axisName(i));
+        MegaBoard::Print(F("\":["));
+        MegaBoard::Print(motors.getPosition(i));
+        MegaBoard::Print(',');
+        MegaBoard::Print(lround(motors.getSpeed(i)));
+        MegaBoard::Print(',');
+        MegaBoard::Print(motors.getDistanceToGo(i));
+        MegaBoard::Print(',');
+        MegaBoard::Print(motors.isEnabled(i) ? '1' : '0');
+        MegaBoard::Print(',');
+        MegaBoard::Print(motors.isLimitReached(i, true) ? '1' : '0');
+        MegaBoard::Print(',');
+        MegaBoard::Print(motors.isLimitReached(i, false) ? '1' : '0');
+        if (motors.hasEncoder(i)) {
+            MegaBoard::Print(',');
+            MegaBoard::Print(motors.getPositionError(i));
+        }
+        MegaBoard::Print(']');
+    }
+    MegaBoard::Println('}');
+}
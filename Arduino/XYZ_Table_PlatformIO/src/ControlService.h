@@ -18,6 +18,23 @@
 
 #include <Arduino.h>
 #include "StepperMotors.h"
+#include "EventLog.h"
+#include "StepBlocks.h"
+#include "JogRecorder.h"
+#include "Strobe.h"
+
+// Z-stack (focus stack) acquisition
+#define ZSTACK_FOCUS_AXIS        'X'  // axis stepped between slices
+#define ZSTACK_TRIGGER_PIN       8    // camera trigger, HIGH during each exposure
+#define ZSTACK_DEFAULT_SETTLE_MS 50   // wait after motion ends, before the trigger
+
+// Time-scheduled commands ('at')
+#define AT_SLOTS        8             // queued commands
+#define AT_LINE_LEN     40            // chars per queued command line
+#define AT_MAX_AHEAD_US 1800000000UL  // 30 min; micros() wraps after ~71 min
+
+// Jog session replay ('replay')
+#define REPLAY_MAX_SCALE 4.0f         // speed factor; acceleration scales with its square
 
 // Service that interprets CLI commands to control motors using a finite state machine
 class ControlService {
@@ -30,20 +47,92 @@ public:
 	static void RunCallback(int arg_cnt, char **args);   // Handles 'run' command
 	static void StopCallback(int arg_cnt, char **args);  // Handles 'stop' command
 	static void MoveCallback(int arg_cnt, char **args);  // Handles 'move' command
+	static void ZStackCallback(int arg_cnt, char **args);// Handles 'zstack' command
+	static void TrackCallback(int arg_cnt, char **args); // Handles 'track' command
+	static void PingCallback(int arg_cnt, char **args);  // Handles 'ping' command
+	static void StatusCallback(int arg_cnt, char **args);// Handles 'status' command
+	static void AtCallback(int arg_cnt, char **args);    // Handles 'at' command
+	static void BlkCallback(int arg_cnt, char **args);   // Handles 'blk' command
+	static void ReplayCallback(int arg_cnt, char **args);// Handles 'replay' command
 
 private:
 	// Possible FSM states
 	enum class FSMState {
 		IDLE,
 		MOVING_CONTINUOUS,
-		MOVING_STEPS
+		MOVING_STEPS,
+		ZSTACK,
+		TRACKING,
+		BLOCKS,
+		REPLAY
+	};
+
+	// Phases of one z-stack slice
+	enum class ZStackPhase {
+		MOVING,
+		SETTLING,
+		EXPOSING
+	};
+
+	struct ZStack {
+		uint8_t     axis;
+		long        start;      // mu (1/1000 unit), absolute
+		long        step;       // mu per slice
+		uint16_t    count;
+		uint16_t    index;      // current slice
+		uint16_t    dwellMs;    // exposure: trigger held HIGH
+		uint16_t    settleMs;
+		ZStackPhase phase;
+		uint32_t    phaseStartMs;
+	};
+
+	// Replay of the recorded jog session (see JogRecorder)
+	struct Replay {
+		float    scale;         // speed factor
+		bool     loop;
+		bool     positioning;   // moving to the recorded start, clock not running
+		uint8_t  next;          // next JogEvent
+		uint16_t pass;
+		uint32_t startMs;
+		float    maxSpeed[AXIS_COUNT];      // settings to restore afterwards
+		float    acceleration[AXIS_COUNT];
+	};
+
+	// One command waiting for the firmware clock
+	struct AtEntry {
+		uint32_t atUs;          // micros() to run at
+		uint16_t id;
+		char     line[AT_LINE_LEN];
 	};
 
 	static StepperMotors motors;  // Stepper motor controller
 	static FSMState aState;       // Current FSM state
+	static ZStack aZStack;        // Active/last z-stack parameters
+	static Replay aReplay;
+	static AtEntry aAtQueue[AT_SLOTS]; // Soonest first
+	static uint8_t aAtCount;
+	static uint16_t aAtNextId;
+	static uint8_t aBatchIdle;    // axes at rest when the batch began, bit per axis
+	static FSMState aBatchState;
 
+	static void setState(FSMState state); // Transition + event record
+	static const __FlashStringHelper *stateName(FSMState state);
 	static void enableMotors();   // Enable all motors
 	static void disableMotors();  // Disable all motors
+	static void zstackLoop();     // Advances the z-stack slice phases
+	static void zstackEnd(const char *reason);
+	static bool parseUint16(const char *text, uint16_t &value); // digits only, no wrap
+	static void atLoop();         // Runs the queued commands that are due
+	static void blocksLoop();     // Reports the end of a step-block playback
+	static bool axesBusy(const char *tag); // Refuses motion commands during playback
+	static void batchBegin();     // Notes what a ';' batch starts from
+	static void batchAbort();     // A batch command was refused: undoes the motion before it
+	static void replayLoop();     // Issues the recorded commands as they fall due
+	static void replayPosition(); // Moves to the recorded start for the next pass
+	static void replayEnd(const char *reason);
+	static void replayRestore();  // Puts back the speed settings of before the replay
+	static void restorePositions(); // Applies the snapshot kept across the reset
+	static void emergencyStop();  // Settles everything after the e-stop byte
 	static bool limitTriggered(); // Check if any limit switch was triggered
 };
 
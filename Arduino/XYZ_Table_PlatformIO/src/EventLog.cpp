@@ -0,0 +1,140 @@
+/**
+ * ===============================================================
+ *  EventLog.cpp
+ *  XYZ Camera Positioning System - On-device Flight Recorder
+ * ===============================================================
+ */
+
+#include "EventLog.h"
+#include "MegaBoard.h"
+#include "AxesConfig.h"
+#include "BoardShim.h"
+
+#define EVENTLOG_MAGIC 0xE71A
+
+#if EVENTLOG_PERSIST
+EventLog::Log EventLog::aLog __attribute__((section(".noinit")));
+#else
+EventLog::Log EventLog::aLog;
+#endif
+
+static const char EV_NAMES[EV_TYPE_COUNT][8] PROGMEM = {
+	"BOOT", "CMD", "FSM", "LIMIT", "RETRACT", "ENABLE", "DISABLE", "STALL", "OVERRUN", "RESTORE", "ESTOP"
+};
+
+uint8_t EventLog::headerCheck()
+{
+	return (uint8_t)(aLog.magic ^ (aLog.magic >> 8) ^ aLog.nextSeq ^ (aLog.nextSeq >> 8) ^
+	                 aLog.head ^ aLog.count ^ 0x5A);
+}
+
+void EventLog::Begin(uint8_t resetFlags)
+{
+#if EVENTLOG_PERSIST
+	BoardKeepNoinit(&aLog, sizeof(aLog));
+#endif
+
+	// After a power-on the .noinit RAM is random: start a fresh log.
+	if (aLog.magic != EVENTLOG_MAGIC || aLog.check != headerCheck() ||
+	    aLog.head >= EVENTLOG_SIZE || aLog.count > EVENTLOG_SIZE)
+		Clear();
+
+	Record(EV_BOOT, EVENT_NO_AXIS, resetFlags);
+}
+
+void EventLog::Clear()
+{
+	aLog.magic   = EVENTLOG_MAGIC;
+	aLog.nextSeq = 0;
+	aLog.head    = 0;
+	aLog.count   = 0;
+	aLog.check   = headerCheck();
+}
+
+void EventLog::Record(uint8_t type, uint8_t axis, int32_t arg)
+{
+	uint8_t sreg = SREG;
+	noInterrupts();
+
+	// Merge runs of loop overruns into one entry that keeps the worst time.
+	uint8_t last = (aLog.head - 1) & (EVENTLOG_SIZE - 1);
+	if (type == EV_OVERRUN && aLog.count && aLog.events[last].type == EV_OVERRUN) {
+		if (arg > aLog.events[last].arg)
+			aLog.events[last].arg = arg;
+		SREG = sreg;
+		return;
+	}
+
+	Event &e = aLog.events[aLog.head];
+	e.seq  = aLog.nextSeq++;
+	e.ms   = millis();
+	e.type = type;
+	e.axis = axis;
+	e.arg  = arg;
+
+	aLog.head = (aLog.head + 1) & (EVENTLOG_SIZE - 1);
+	if (aLog.count < EVENTLOG_SIZE)
+		aLog.count++;
+	aLog.check = headerCheck();
+
+	SREG = sreg;
+}
+
+void EventLog::RecordCommand(const char *name)
+{
+	int32_t packed = 0;
+	for (uint8_t i = 0; i < 4 && name[i]; i++)
+		packed |= (int32_t)(uint8_t)name[i] << (8 * i);
+	Record(EV_COMMAND, EVENT_NO_AXIS, packed);
+}
+
+void EventLog::Dump()
+{
+	uint8_t count = aLog.count;
+	uint8_t idx   = (aLog.head - count) & (EVENTLOG_SIZE - 1);
+	char    name[8];
+
+	for (uint8_t n = 0; n < count; n++) {
+		noInterrupts();
+		Event e = aLog.events[idx];
+		interrupts();
+		idx = (idx + 1) & (EVENTLOG_SIZE - 1);
+
+		strcpy_P(name, e.type < EV_TYPE_COUNT ? EV_NAMES[e.type] : PSTR("?"));
+		MegaBoard::Print("#");
+		MegaBoard::Print(e.seq);
+		MegaBoard::Print(" t=");
+		MegaBoard::Print(e.ms);
+		MegaBoard::Print(" ");
+		MegaBoard::Print(name);
+		if (e.axis < AXIS_COUNT) {
+			MegaBoard::Print(" ");
+			MegaBoard::Print(AXES_CONFIG[e.axis].name);
+		}
+		MegaBoard::Print(" ");
+		if (e.type == EV_COMMAND) {
+			for (uint8_t i = 0; i < 4; i++) {
+				char c = (char)(e.arg >> (8 * i));
+				if (c) MegaBoard::Print(c);
+			}
+		} else {
+			MegaBoard::Print(e.arg);
+		}
+		MegaBoard::Println();
+	}
+	MegaBoard::Println("[Events] " + String(count) + " of " + String(aLog.nextSeq));
+}
+
+// Usage: events         dump the flight recorder
+//        events clear   empty it
+void EventLog::EventsCallback(int arg_cnt, char **args)
+{
+	if (arg_cnt > 1 && !strcmp(args[1], "clear")) {
+		noInterrupts();
+		Clear();
+		interrupts();
+		MegaBoard::Println("[Events] Cleared");
+		return;
+	}
+	Dump();
+}
@@ -0,0 +1,76 @@
+/**
+ * ===============================================================
+ *  EventLog.h
+ *  XYZ Camera Positioning System - On-device Flight Recorder
+ * ===============================================================
+ *  Description:
+ *  - RAM ring buffer of timestamped binary motion/safety events with
+ *    sequence numbers, cheap enough to stay on permanently.
+ *  - With EVENTLOG_PERSIST the buffer lives in .noinit and survives a
+ *    watchdog or software reset (not a power cycle).
+ *  - Dumped on demand with the 'events' command.
+ * ===============================================================
+ */
+
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#define EVENTLOG_SIZE    64      // entries, power of two
+#define EVENTLOG_PERSIST 1       // keep the log across non-power-on resets
+#define EVENT_NO_AXIS    0xFF
+
+enum EventType : uint8_t {
+	EV_BOOT = 0,      // arg = MCUSR reset flags
+	EV_COMMAND,       // arg = first 4 chars of the command name
+	EV_FSM,           // arg = new ControlService state
+	EV_LIMIT,         // arg = 1 min / 0 max
+	EV_RETRACT_DONE,
+	EV_ENABLE,
+	EV_DISABLE,
+	EV_STALL,         // arg = position error (steps)
+	EV_OVERRUN,       // arg = worst loop time (us) of a run of overruns
+	EV_RESTORE,       // arg = WarmSource the positions were restored from
+	EV_ESTOP,         // arg = trip to service time (us)
+	EV_TYPE_COUNT
+};
+
+struct Event {
+	uint16_t seq;
+	uint32_t ms;
+	uint8_t  type;
+	uint8_t  axis;
+	int32_t  arg;
+};
+
+class EventLog {
+public:
+	static void Begin(uint8_t resetFlags);  // validates or clears the buffer
+	static void Record(uint8_t type, uint8_t axis = EVENT_NO_AXIS, int32_t arg = 0); // ISR-safe
+	static void RecordCommand(const char *name);
+	static void Clear();
+	static void Dump();                     // oldest → newest, one line per event
+
+	static void EventsCallback(int arg_cnt, char **args);
+
+private:
+	struct Log {
+		uint16_t magic;
+		uint16_t nextSeq;
+		uint8_t  head;      // next slot to write
+		uint8_t  count;
+		uint8_t  check;     // guards the header fields above
+		Event    events[EVENTLOG_SIZE];
+	};
+
+	static Log aLog;
+
+	static uint8_t headerCheck();
+};
+
+#endif /* EVENTLOG_H_ */
@@ -0,0 +1,141 @@
+/**
+ * ===============================================================
+ *  JogRecorder.cpp
+ *  XYZ Camera Positioning System - Manual Jog Session Recorder
+ * ===============================================================
+ */
+
+#include "JogRecorder.h"
+#include "StepperMotors.h"
+#include "MegaBoard.h"
+
+static const char JOG_NAMES[][6] PROGMEM = { "RUN", "STOP", "SPEED" };
+
+StepperMotors         *JogRecorder::aMotors     = nullptr;
+bool                   JogRecorder::aRecording  = false;
+uint32_t               JogRecorder::aStartMs    = 0;
+uint32_t               JogRecorder::aDurationMs = 0;
+uint8_t                JogRecorder::aCount      = 0;
+JogRecorder::AxisStart JogRecorder::aStart[AXIS_COUNT];
+JogEvent               JogRecorder::aEvents[JOG_SLOTS];
+
+void JogRecorder::start()
+{
+	aCount      = 0;
+	aDurationMs = 0;
+	aStartMs    = millis();
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		MotorSettings m = aMotors->getMotorSettings(i);
+		aStart[i].steps        = aMotors->getPosition(i);
+		aStart[i].maxSpeed     = m.maxSpeed;
+		aStart[i].acceleration = m.acceleration;
+		if (aMotors->isRunning(i))   // already jogging: replay it from here
+			add(JOG_RUN, i, aMotors->getSpeed(i) < 0 ? -1 : 1, aStart[i].steps);
+	}
+	aRecording = true;
+}
+
+// Axes still running at the end get a stop there, at their braking
+// distance, so a replay never leaves an axis running. The last
+// AXIS_COUNT slots are kept for these.
+void JogRecorder::finish()
+{
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		if (!aMotors->isRunning(i))
+			continue;
+		float v = aMotors->getSpeed(i);
+		float a = aMotors->getMotorSettings(i).acceleration;
+		add(JOG_STOP, i, 0, aMotors->getPosition(i) + lround(v * fabs(v) / (2.0f * a)));
+	}
+	aDurationMs = millis() - aStartMs;
+	aRecording  = false;
+}
+
+bool JogRecorder::room()
+{
+	if (!aRecording)
+		return false;
+	if (aCount < JOG_SLOTS - AXIS_COUNT)
+		return true;
+	finish();
+	MegaBoard::Println("^REC [full]");
+	return false;
+}
+
+void JogRecorder::add(uint8_t action, uint8_t axis, int16_t value, long steps)
+{
+	JogEvent &e = aEvents[aCount++];
+	e.ms     = millis() - aStartMs;
+	e.action = action;
+	e.axis   = axis;
+	e.value  = value;
+	e.steps  = steps;
+}
+
+void JogRecorder::Run(uint8_t axis, int8_t direction)
+{
+	if (room())
+		add(JOG_RUN, axis, direction, aMotors->getPosition(axis));
+}
+
+// The stop was just issued: the position left to go is where it ends.
+void JogRecorder::Stop(uint8_t axis)
+{
+	if (aMotors->isRunning(axis) && room())
+		add(JOG_STOP, axis, 0, aMotors->getPosition(axis) + aMotors->getDistanceToGo(axis));
+}
+
+void JogRecorder::Speed(uint8_t axis, float maxSpeed)
+{
+	if (room())
+		add(JOG_SPEED, axis, (int16_t)constrain(lround(maxSpeed), 1L, 32767L), 0);
+}
+
+void JogRecorder::dump()
+{
+	char name[6];
+	for (uint8_t n = 0; n < aCount; n++) {
+		const JogEvent &e = aEvents[n];
+		strcpy_P(name, JOG_NAMES[e.action]);
+		MegaBoard::Print("t=");
+		MegaBoard::Print(e.ms);
+		MegaBoard::Print(" ");
+		MegaBoard::Print(name);
+		MegaBoard::Print(" ");
+		MegaBoard::Print(StepperMotors::axisName(e.axis));
+		if (e.action == JOG_RUN) {
+			MegaBoard::Print(e.value < 0 ? " - @" : " + @");
+			MegaBoard::Print(e.steps);
+		} else if (e.action == JOG_STOP) {
+			MegaBoard::Print(" @");
+			MegaBoard::Print(e.steps);
+		} else {
+			MegaBoard::Print(" ");
+			MegaBoard::Print(e.value);
+		}
+		MegaBoard::Println();
+	}
+	String summary = "[Rec] " + String(aCount) + " events";
+	if (!aRecording)
+		summary += ", " + String(aDurationMs) + " ms";
+	MegaBoard::Println(summary + (aRecording ? ", recording" : ""));
+}
+
+// Usage: rec start | rec stop   record the 'run'/'stop'/maxSpeed commands in between
+//        rec                    list the recording
+void JogRecorder::RecCallback(int arg_cnt, char **args)
+{
+	if (arg_cnt > 1 && !strcmp(args[1], "start")) {
+		start();
+		MegaBoard::Println("[Rec] Recording");
+	} else if (arg_cnt > 1 && !strcmp(args[1], "stop")) {
+		if (aRecording)
+			finish();
+		MegaBoard::Println("[Rec] " + String(aCount) + " events, " + String(aDurationMs) + " ms");
+	} else if (arg_cnt > 1) {
+		Cmd::Refuse();
+		MegaBoard::Println("[Rec] Usage: rec [start|stop]");
+	} else {
+		dump();
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * ===============================================================
+ *  JogRecorder.h
+ *  XYZ Camera Positioning System - Manual Jog Session Recorder
+ * ===============================================================
+ *  Description:
+ *  - Between 'rec start' and 'rec stop', records every 'run', 'stop'
+ *    and maxSpeed change with its time and the resulting position,
+ *    plus where the axes started and their speed settings.
+ *  - A stop is recorded with the position the axis comes to rest at,
+ *    so a replay ('replay', see ControlService) ends every leg on the
+ *    recorded step instead of wherever its deceleration ends.
+ *  - Dumped with 'rec'; kept in RAM until the next 'rec start'.
+ * ===============================================================
+ */
+
+#ifndef JOGRECORDER_H_
+#define JOGRECORDER_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "AxesConfig.h"
+
+#define JOG_SLOTS 48            // recorded events, 12 bytes each
+
+enum JogAction : uint8_t {
+	JOG_RUN = 0,                // value = direction (+1/-1), steps = position at the command
+	JOG_STOP,                   // steps = rest position
+	JOG_SPEED                   // value = new maxSpeed (steps/s)
+};
+
+struct JogEvent {
+	uint32_t ms;                // since 'rec start'
+	uint8_t  action;
+	uint8_t  axis;
+	int16_t  value;
+	int32_t  steps;             // fine steps
+};
+
+class StepperMotors;
+
+class JogRecorder {
+public:
+	static void Begin(StepperMotors *motors) { aMotors = motors; }
+	static bool Recording() { return aRecording; }
+
+	// Hooks from the 'run', 'stop' and 'axe' commands; ignored unless recording.
+	static void Run(uint8_t axis, int8_t direction);
+	static void Stop(uint8_t axis);         // after StepperMotors::stop()
+	static void Speed(uint8_t axis, float maxSpeed);
+
+	static uint8_t Count() { return aCount; }
+	static const JogEvent &Event(uint8_t i) { return aEvents[i]; }
+	static uint32_t DurationMs() { return aDurationMs; }
+	static long StartSteps(uint8_t axis) { return aStart[axis].steps; }
+	static float StartSpeed(uint8_t axis) { return aStart[axis].maxSpeed; }
+	static float StartAcceleration(uint8_t axis) { return aStart[axis].acceleration; }
+
+	static void RecCallback(int arg_cnt, char **args);
+
+private:
+	struct AxisStart {
+		long  steps;
+		float maxSpeed;
+		float acceleration;
+	};
+
+	static StepperMotors *aMotors;
+	static bool      aRecording;
+	static uint32_t  aStartMs;
+	static uint32_t  aDurationMs;
+	static uint8_t   aCount;
+	static AxisStart aStart[AXIS_COUNT];
+	static JogEvent  aEvents[JOG_SLOTS];
+
+	static void start();
+	static void finish();
+	static bool room();                     // false when not recording or full
+	static void add(uint8_t action, uint8_t axis, int16_t value, long steps);
+	static void dump();
+};
+
+#endif /* JOGRECORDER_H_ */
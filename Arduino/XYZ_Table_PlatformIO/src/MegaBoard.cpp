@@ -1,7 +1,97 @@
 #include "MegaBoard.h"
+#include "BoardShim.h"
+#include "HardwareSerial_private.h"    // the core's inline constructor and UCSR0A bit names
+#include <util/crc16.h>
+
+bool     MegaBoard::holdReplies   = false;
+uint32_t MegaBoard::baudRate      = BOARD_SERIAL_BAUDRATE;
+uint32_t MegaBoard::confirmedBaud = BOARD_SERIAL_BAUDRATE;
+uint32_t MegaBoard::switchTo      = 0;
+uint32_t MegaBoard::switchedMs    = 0;
+bool     MegaBoard::baudPending   = false;
+void   (*MegaBoard::estopHandler)(void) = nullptr;
+
+// Rates with an exact U2X divisor at 16 MHz, plus the reset rate (2.1 %
+// fast, like the USB-serial chip's own divisor for it).
+static const uint32_t BAUD_RATES[] PROGMEM = { 115200, 250000, 500000, 1000000, 2000000 };
 
 #define FS(x) (__FlashStringHelper *)(x)
 
+extern int __heap_start, *__brkval;
+
+#if BOARD_MEMORY_MAP
+// Linker-script symbols bounding each RAM region.
+extern uint8_t __data_start, __data_end, __bss_start, __bss_end;
+extern uint8_t __noinit_start, __noinit_end, _end, __stack;
+
+// avr-libc's malloc free list.
+struct __freelist {
+    size_t             sz;
+    struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+// Runs from .init1, before the C runtime has set up the stack: fills
+// everything from the end of static data (_end) to the top of RAM with
+// STACK_CANARY (0xC5). Must stay register-only asm.
+void paintStack(void) __attribute__((naked, used, section(".init1")));
+void paintStack(void)
+{
+    __asm volatile(
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, 0xC5\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n");
+}
+#endif
+
+// The core defines Serial and its USART0 vectors together in
+// HardwareSerial0.cpp. Nothing references Serial, so that object stays out
+// of the link and these take its place.
+BoardUart BoardSerial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0);
+
+ISR(USART0_RX_vect)   { BoardSerial.rxInterrupt(); }
+ISR(USART0_UDRE_vect) { BoardSerial._tx_udr_empty_irq(); }
+
+// HardwareSerial::_rx_complete_irq(), but the e-stop byte never reaches the
+// buffer: it drops the input queued before it, so no buffered command runs
+// after the stop, and stops the machine before this interrupt returns.
+void BoardUart::rxInterrupt(void)
+{
+    if (bit_is_set(*_ucsra, UPE0)) {
+        *_udr;                          // parity error: drop it
+        return;
+    }
+    unsigned char c = *_udr;
+    if (c == BOARD_ESTOP_BYTE) {
+        _rx_buffer_tail = _rx_buffer_head;
+        MegaBoard::EmergencyStop();
+        return;
+    }
+    rx_buffer_index_t i = (unsigned int)(_rx_buffer_head + 1) % SERIAL_RX_BUFFER_SIZE;
+    if (i != _rx_buffer_tail) {
+        _rx_buffer[_rx_buffer_head] = c;
+        _rx_buffer_head = i;
+    }
+}
+
+// The core's read() advances the tail in two steps; rxInterrupt() may move it
+// in between, so it runs with interrupts off.
+int BoardUart::read(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    int c = HardwareSerial::read();
+    SREG = sreg;
+    return c;
+}
+
 const char APP_NAME[]   PROGMEM = "XYZ-Table";
 const char FW_VERSION[] PROGMEM = "v1.0.0";
 
@@ -10,6 +100,91 @@ void MegaBoard::Begin(void)
     BOARD_SERIAL.begin(BOARD_SERIAL_BAUDRATE);
 }
 
+// Sends what is still queued at the old rate first.
+void MegaBoard::setBaud(uint32_t rate)
+{
+    BOARD_SERIAL.flush();
+    BOARD_SERIAL.end();
+    BOARD_SERIAL.begin(rate);
+    baudRate = rate;
+}
+
+void MegaBoard::BaudLoop(void)
+{
+    if (switchTo) {
+        setBaud(switchTo);
+        switchTo    = 0;
+        switchedMs  = millis();
+        baudPending = true;
+    } else if (baudPending && millis() - switchedMs >= BOARD_BAUD_CONFIRM_MS) {
+        baudPending = false;
+        setBaud(confirmedBaud);
+        MegaBoard::Println("^BAUD [fallback " + String(confirmedBaud) + "]");
+    }
+}
+
+// Usage: baud <rate>             switch after this reply; falls back unless confirmed
+//        baud check <text> <crc> CRC-16 (avr-libc, 0xFFFF start) of <text>, 4 hex digits:
+//                                replies the text and the CRC computed here, ok or bad
+//        baud ok                 keep the new rate
+//        baud                    current rate (JSON)
+void MegaBoard::BaudCallback(int arg_cnt, char **args)
+{
+    if (arg_cnt < 2) {
+        MegaBoard::Print(F("{\"baud\":"));
+        MegaBoard::Print(baudRate);
+        MegaBoard::Print(F(",\"confirmed\":"));
+        MegaBoard::Print(baudPending ? F("false") : F("true"));
+        MegaBoard::Print(F(",\"rates\":["));
+        for (uint8_t i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++) {
+            if (i)
+                MegaBoard::Print(',');
+            MegaBoard::Print(pgm_read_dword(&BAUD_RATES[i]));
+        }
+        MegaBoard::Println(F("]}"));
+        return;
+    }
+
+    if (!strcmp(args[1], "check") && arg_cnt == 4) {
+        uint16_t crc = 0xFFFF;
+        for (const char *p = args[2]; *p; p++)
+            crc = _crc16_update(crc, *p);
+        char hex[5];
+        snprintf(hex, sizeof(hex), "%04X", crc);
+        MegaBoard::Print(F("[Baud] check "));
+        MegaBoard::Print(args[2]);
+        MegaBoard::Print(' ');
+        MegaBoard::Print(hex);
+        MegaBoard::Println(strcasecmp(hex, args[3]) ? F(" bad") : F(" ok"));
+        return;
+    }
+
+    if (!strcmp(args[1], "ok")) {
+        if (baudPending) {
+            baudPending   = false;
+            confirmedBaud = baudRate;
+        }
+        MegaBoard::Println("[Baud] " + String(baudRate) + " confirmed");
+        return;
+    }
+
+    uint32_t rate = strtoul(args[1], NULL, 10);
+    bool     known = false;
+    for (uint8_t i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++)
+        known |= (pgm_read_dword(&BAUD_RATES[i]) == rate);
+    if (!known) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Baud] Usage: baud <115200|250000|500000|1000000|2000000> | baud check <text> <crc> | baud ok"));
+    } else if (baudPending || switchTo) {
+        Cmd::Refuse();
+        MegaBoard::Println(F("[Baud] Switch pending, confirm or wait for the fallback"));
+    } else {
+        switchTo = rate;
+        MegaBoard::Println("[Baud] Switching to " + String(rate) + ", confirm within " +
+                           String(BOARD_BAUD_CONFIRM_MS) + " ms");
+    }
+}
+
 void MegaBoard::Version(void)
 {
     MegaBoard::Print(FS(APP_NAME));
@@ -17,9 +192,12 @@ void MegaBoard::Version(void)
     MegaBoard::Println(FS(FW_VERSION));
 }
 
+// A real reset through the watchdog rather than jmp 0, so every peripheral
+// starts from its reset state. RAM, and with it the .noinit snapshots, is kept.
 void MegaBoard::Reboot(void)
 {
-    asm volatile("  jmp 0");
+    BOARD_SERIAL.flush();
+    BoardReset();
 }
 
 String MegaBoard::toJSON(String key, String value)
@@ -29,7 +207,76 @@ String MegaBoard::toJSON(String key, String value)
 
 uint32_t MegaBoard::FreeRam()
 {
-    extern int __heap_start, *__brkval;
     int v;
-    return (int)&v - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+    return (uintptr_t)&v - (__brkval == 0 ? (uintptr_t)&__heap_start : (uintptr_t)__brkval);
+}
+
+// Canary bytes still intact above the heap top: the smallest gap the stack
+// has ever left. Conservative if the heap shrank after growing.
+uint16_t MegaBoard::StackHighWater(void)
+{
+#if !BOARD_MEMORY_MAP
+    return 0;
+#else
+    const uint8_t *p = (__brkval == 0) ? (const uint8_t *)&__heap_start : (const uint8_t *)__brkval;
+    uint16_t free = 0;
+    while (p <= &__stack && *p == STACK_CANARY) {
+        p++;
+        free++;
+    }
+    return free;
+#endif
+}
+
+HeapStats MegaBoard::GetHeapStats(void)
+{
+    HeapStats h = {0, 0, 0, 0};
+#if BOARD_MEMORY_MAP
+    h.used = (__brkval == 0) ? 0 : (uint16_t)((uint8_t *)__brkval - (uint8_t *)&__heap_start);
+
+    uint8_t sreg = SREG;
+    noInterrupts();
+    for (struct __freelist *fp = __flp; fp; fp = fp->nx) {
+        h.freeBytes += fp->sz;
+        h.freeBlocks++;
+        if (fp->sz > h.largestFree)
+            h.largestFree = fp->sz;
+    }
+    SREG = sreg;
+#endif
+    return h;
+}
+
+// Usage: mem — static footprint, heap use/fragmentation and stack headroom.
+// Built without String so the report itself does not touch the heap.
+void MegaBoard::MemCallback(int arg_cnt, char **args)
+{
+#if !BOARD_MEMORY_MAP
+    MegaBoard::Println(F("[Mem] no memory map on this build"));
+#else
+    HeapStats h = GetHeapStats();
+
+    MegaBoard::Print(F("static data="));
+    MegaBoard::Print((uint16_t)(&__data_end - &__data_start));
+    MegaBoard::Print(F(" bss="));
+    MegaBoard::Print((uint16_t)(&__bss_end - &__bss_start));
+    MegaBoard::Print(F(" noinit="));
+    MegaBoard::Print((uint16_t)(&__noinit_end - &__noinit_start));
+    MegaBoard::Println();
+
+    MegaBoard::Print(F("heap used="));
+    MegaBoard::Print(h.used);
+    MegaBoard::Print(F(" freeList="));
+    MegaBoard::Print(h.freeBytes);
+    MegaBoard::Print(F(" blocks="));
+    MegaBoard::Print(h.freeBlocks);
+    MegaBoard::Print(F(" largest="));
+    MegaBoard::Print(h.largestFree);
+    MegaBoard::Println();
+
+    MegaBoard::Print(F("stack free="));
+    MegaBoard::Print(FreeRam());
+    MegaBoard::Print(F(" minFree="));
+    MegaBoard::Println(StackHighWater());
+#endif
 }
@@ -25,9 +25,35 @@
 #include "Cmd.h"
 
 #define BOARD_SERIAL CMD_SERIAL
-#define BOARD_SERIAL_BAUDRATE 115200
+#define BOARD_SERIAL_BAUDRATE 115200     // at reset; 'baud' switches to a faster rate
+#define BOARD_BAUD_CONFIRM_MS 1000       // a new rate falls back unless 'baud ok' comes in time
+#define BOARD_ESTOP_BYTE      0x18       // CAN (Ctrl-X): emergency stop, never part of a command
 #define SERIAL_EOL "\n"
 
+// Free RAM between heap and stack is filled with this at reset, so the
+// deepest stack use can be read back later (see MegaBoard::StackHighWater).
+#define STACK_CANARY 0xC5
+
+// USART0 with its own receive interrupt: the core's, except that
+// BOARD_ESTOP_BYTE drops the buffered input and stops the machine there and
+// then (see MegaBoard::EmergencyStop). Replaces Serial; platformio.ini
+// points CMD_SERIAL at it.
+class BoardUart : public HardwareSerial {
+public:
+	using HardwareSerial::HardwareSerial;
+	void rxInterrupt(void);
+	int  read(void) override;
+};
+
+extern BoardUart BoardSerial;
+
+struct HeapStats {
+	uint16_t used;          // __heap_start .. __brkval
+	uint16_t freeBytes;     // sum of the malloc free list (reusable holes)
+	uint8_t  freeBlocks;
+	uint16_t largestFree;
+};
+
 
 class MegaBoard {
 public:
@@ -42,9 +68,17 @@ public:
     static void Println(const T& value) {
         BOARD_SERIAL.print(value);
         BOARD_SERIAL.print(SERIAL_EOL);
-		BOARD_SERIAL.print((char)0x3); // ETX for the server
+		if (!holdReplies)
+			BOARD_SERIAL.print((char)0x3); // ETX for the server
     }
 
+	// Batched commands: their replies share one ETX, sent by EndReply().
+	static void HoldReplies() { holdReplies = true; }
+	static void EndReply() {
+		holdReplies = false;
+		BOARD_SERIAL.print((char)0x3);
+	}
+
 	static void Println() {
 		BOARD_SERIAL.print(SERIAL_EOL);
 	}
@@ -55,9 +89,29 @@ public:
 	static void Version(void);
 	static void Reboot(void);
 	static uint32_t FreeRam(void);
+	static uint16_t StackHighWater(void);  // fewest bytes ever free between heap and stack
+	static HeapStats GetHeapStats(void);
+	static void MemCallback(int arg_cnt, char **args);
+
+	/* Link speed negotiation ('baud') */
+	static uint32_t Baud(void) { return baudRate; }
+	static void BaudLoop(void);            // switches after the reply, falls back unconfirmed
+	static void BaudCallback(int arg_cnt, char **args);
+
+	/* Out-of-band emergency stop: BOARD_ESTOP_BYTE seen by the receive ISR */
+	static void OnEmergencyStop(void (*handler)(void)) { estopHandler = handler; }
+	static void EmergencyStop(void) { if (estopHandler) estopHandler(); }
 
 private:
+	static bool holdReplies;
+	static uint32_t baudRate;
+	static uint32_t confirmedBaud;         // the rate to fall back to
+	static uint32_t switchTo;              // requested, once the reply has gone out
+	static uint32_t switchedMs;
+	static bool     baudPending;           // switched, not yet confirmed
+	static void   (*estopHandler)(void);   // runs in interrupt context
 
+	static void setBaud(uint32_t rate);
 };
 
 #endif /* MEGABOARD_H_ */
@@ -20,6 +20,7 @@ Scheduler::Scheduler() {
 	aStatusLed = FancyLED(STATUS_LED_PIN, LOW);
 	aCLIService = CLIService();
 	aMotorControl = ControlService();
+	aLoopStartUs = 0;
 
 }
 //<<destructor>>
@@ -29,6 +30,8 @@ Scheduler::~Scheduler() {
 /* Method TO BE CALLED IN THE SKETCH SETUP() */
 void Scheduler::Begin() {
 
+	EventLog::Begin(WarmStart::Begin());
+
 	MegaBoard::Begin();
 
 	/* Init the Status LED */
@@ -40,7 +43,9 @@ void Scheduler::Begin() {
 
 	/* Init Command Line Interface */
 	aCLIService.Begin();
-	delay(1500);
+	/* Warm restart: the positions survived, come back without the settle delay */
+	if (WarmStart::Source() != WarmSource::RAM)
+		delay(1500);
 	MegaBoard::Println("\n\n^SYSTART\n");	
 
 	/* Init the stepper motor control */
@@ -49,18 +54,29 @@ void Scheduler::Begin() {
 	/* LED off once initialization has ended */
 	aStatusLed.TurnOff();
 
-	while (Serial.available() > 0) {
-		Serial.read();
+	while (BOARD_SERIAL.available() > 0) {
+		BOARD_SERIAL.read();
 	}
 
 	// System prompt
 	aCLIService.PrintPrompt();
+	aLoopStartUs = micros();
+	WarmStart::EnableWatchdog();
 }
 
 void Scheduler::Loop() {
+	/* A stuck iteration resets the board; the positions survive it */
+	wdt_reset();
+
 	/* Scheduled task and priorities */
 	aStatusLed.Loop();
 	aCLIService.Loop();
 	aMotorControl.Loop();
+
+	/* Flight recorder: slow iterations starve the step generation */
+	uint32_t now = micros();
+	if (now - aLoopStartUs > LOOP_OVERRUN_US)
+		EventLog::Record(EV_OVERRUN, EVENT_NO_AXIS, now - aLoopStartUs);
+	aLoopStartUs = now;
 }
 
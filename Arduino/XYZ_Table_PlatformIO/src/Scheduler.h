@@ -27,8 +27,11 @@
 #include "FancyLED.h"
 #include "CLIService.h"
 #include "ControlService.h"
+#include "EventLog.h"
+#include "WarmStart.h"
 
 #define STATUS_LED_PIN 13
+#define LOOP_OVERRUN_US 10000	// main loop iterations longer than this are logged
 
 class Scheduler {
 public:
@@ -41,5 +44,6 @@ private:
 	FancyLED aStatusLed;
 	CLIService aCLIService;
 	ControlService aMotorControl;
+	uint32_t aLoopStartUs;
 };
 #endif
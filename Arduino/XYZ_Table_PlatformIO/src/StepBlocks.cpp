@@ -0,0 +1,212 @@
+/**
+ * ===============================================================
+ *  StepBlocks.cpp
+ *  XYZ Camera Positioning System - Pre-computed Step Block Playback
+ * ===============================================================
+ */
+
+#include "StepBlocks.h"
+#include "StepperMotors.h"
+#include "BoardShim.h"
+
+StepperMotors       *StepBlocks::aMotors = nullptr;
+StepBlocks::Output   StepBlocks::aOutputs[AXIS_COUNT];
+StepBlock            StepBlocks::aQueue[BLOCK_SLOTS];
+volatile uint8_t     StepBlocks::aHead   = 0;
+volatile uint8_t     StepBlocks::aTail   = 0;
+volatile BlockState  StepBlocks::aState  = BlockState::IDLE;
+volatile bool        StepBlocks::aEnded  = false;
+volatile uint16_t    StepBlocks::aPlayed = 0;
+volatile int16_t     StepBlocks::aMoved[AXIS_COUNT];
+volatile uint16_t    StepBlocks::aPulses[AXIS_COUNT];
+long                 StepBlocks::aPlanned[AXIS_COUNT];
+uint16_t             StepBlocks::aTicks     = 0;
+uint16_t             StepBlocks::aTicksLeft = 0;
+uint16_t             StepBlocks::aRate[AXIS_COUNT];
+uint16_t             StepBlocks::aAcc[AXIS_COUNT];
+int8_t               StepBlocks::aDir[AXIS_COUNT];
+uint8_t              StepBlocks::aRaised   = 0;
+uint8_t              StepBlocks::aInverted = 0;
+
+ISR(TIMER3_COMPA_vect) { StepBlocks::Tick(); }
+
+// Timer3 in CTC mode, clk/8: one compare match every BLOCK_TICK_US, kept
+// stopped until Start().
+void StepBlocks::Begin(StepperMotors *motors)
+{
+	aMotors = motors;
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		Output &o  = aOutputs[i];
+		o.stepPin  = AXES_CONFIG[i].stepPin;
+		o.dirPin   = AXES_CONFIG[i].dirPin;
+		o.stepReg  = portOutputRegister(digitalPinToPort(o.stepPin));
+		o.stepMask = digitalPinToBitMask(o.stepPin);
+		o.dirReg   = portOutputRegister(digitalPinToPort(o.dirPin));
+		o.dirMask  = digitalPinToBitMask(o.dirPin);
+	}
+
+	TIMSK3 = 0;
+	TCCR3A = 0;
+	TCCR3B = _BV(WGM32);
+	OCR3A  = (F_CPU / 8 / 1000000UL) * BLOCK_TICK_US - 1;
+	Clear();
+}
+
+bool StepBlocks::Push(const StepBlock &block)
+{
+	if (Free() == 0)
+		return false;
+
+	for (uint8_t i = 0; i < AXIS_COUNT; i++)
+		aPlanned[i] = Planned(i) + block.steps[i];
+
+	aQueue[aTail] = block;
+	aTail = (aTail + 1) % BLOCK_SLOTS;     // last: hands the slot to the ISR
+	return true;
+}
+
+// The first block after Clear() plans from where the axis stands.
+long StepBlocks::Planned(uint8_t axis)
+{
+	if (aState == BlockState::IDLE && aHead == aTail)
+		return aMotors->getPosition(axis);
+	return aPlanned[axis];
+}
+
+uint8_t StepBlocks::Queued()
+{
+	return (aTail + BLOCK_SLOTS - aHead) % BLOCK_SLOTS;
+}
+
+void StepBlocks::Start()
+{
+	aInverted = 0;
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		aMoved[i] = 0;
+		if (aMotors->getMotorSettings(i).invertDirection)
+			aInverted |= _BV(i);
+	}
+	aTicksLeft = 0;
+	aRaised    = 0;
+	aPlayed    = 0;
+	aState     = BlockState::PLAYING;
+
+	TCNT3  = 0;
+	TIFR3  = _BV(OCF3A);
+	TCCR3B = _BV(WGM32) | _BV(CS31);
+	TIMSK3 = _BV(OCIE3A);
+}
+
+void StepBlocks::stopTimer()
+{
+	TIMSK3 = 0;
+	TCCR3B = _BV(WGM32);
+	for (uint8_t i = 0; i < AXIS_COUNT; i++)
+		if (aRaised & _BV(i))
+			BoardWritePin(aOutputs[i].stepReg, aOutputs[i].stepMask, aOutputs[i].stepPin, false);
+	aRaised = 0;
+}
+
+void StepBlocks::Clear()
+{
+	noInterrupts();
+	stopTimer();
+	aHead  = aTail = 0;
+	aEnded = false;
+	aState = BlockState::IDLE;
+	interrupts();
+}
+
+// The limit service releases the gate that Tick() checks, possibly before
+// Tick() has seen it: stop here so playback cannot carry on past the switch.
+void StepBlocks::Halt()
+{
+	noInterrupts();
+	if (aState == BlockState::PLAYING) {
+		stopTimer();
+		aState = BlockState::HALTED;
+	}
+	interrupts();
+}
+
+const __FlashStringHelper *StepBlocks::StateName()
+{
+	switch (aState) {
+	case BlockState::IDLE:     return F("IDLE");
+	case BlockState::PLAYING:  return F("PLAYING");
+	case BlockState::DONE:     return F("DONE");
+	case BlockState::UNDERRUN: return F("UNDERRUN");
+	case BlockState::HALTED:   return F("HALTED");
+	}
+	return F("?");
+}
+
+void StepBlocks::Loop()
+{
+	int16_t moved[AXIS_COUNT];
+
+	noInterrupts();
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		moved[i]  = aMoved[i];
+		aMoved[i] = 0;
+	}
+	interrupts();
+
+	for (uint8_t i = 0; i < AXIS_COUNT; i++)
+		if (moved[i])
+			aMotors->addSteps(i, moved[i]);
+}
+
+// One DDA tick. The accumulator starts below half a block, so a block's
+// first tick never steps: the DIR lines written when it is loaded get a
+// full tick of setup time before the first STEP edge.
+void StepBlocks::Tick()
+{
+	for (uint8_t i = 0; i < AXIS_COUNT; i++)
+		if (aRaised & _BV(i))
+			BoardWritePin(aOutputs[i].stepReg, aOutputs[i].stepMask, aOutputs[i].stepPin, false);
+	aRaised = 0;
+
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		if (aMotors->isHalted(i)) {
+			stopTimer();
+			aState = BlockState::HALTED;
+			return;
+		}
+	}
+
+	if (aTicksLeft == 0) {
+		if (aHead == aTail) {
+			stopTimer();
+			aState = aEnded ? BlockState::DONE : BlockState::UNDERRUN;
+			return;
+		}
+		const StepBlock &b = aQueue[aHead];
+		aTicks     = b.ticks;
+		aTicksLeft = b.ticks;
+		for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+			int16_t s = b.steps[i];
+			aRate[i]  = (s < 0) ? -s : s;
+			aAcc[i]   = (b.ticks - 1) / 2;
+			if (s != 0) {
+				aDir[i] = (s > 0) ? 1 : -1;
+				bool high = (s > 0) ^ ((aInverted & _BV(i)) != 0);
+				BoardWritePin(aOutputs[i].dirReg, aOutputs[i].dirMask, aOutputs[i].dirPin, high);
+			}
+		}
+		aHead = (aHead + 1) % BLOCK_SLOTS;
+		aPlayed++;
+	}
+
+	for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+		aAcc[i] += aRate[i];
+		if (aAcc[i] >= aTicks) {
+			aAcc[i] -= aTicks;
+			BoardWritePin(aOutputs[i].stepReg, aOutputs[i].stepMask, aOutputs[i].stepPin, true);
+			aRaised   |= _BV(i);
+			aMoved[i] += aDir[i];
+			aPulses[i] += aDir[i];
+		}
+	}
+	aTicksLeft--;
+}
@@ -0,0 +1,114 @@
+/**
+ * ===============================================================
+ *  StepBlocks.h
+ *  XYZ Camera Positioning System - Pre-computed Step Block Playback
+ * ===============================================================
+ *  Description:
+ *  - Plays back step blocks compiled on the host (Python/tools/
+ *    xyzTrajectory.py): each block is a duration plus a signed step
+ *    count per axis, so the host plans the whole profile and the
+ *    firmware only spreads the steps evenly over the block.
+ *  - A Timer3 compare interrupt at BLOCK_TICK_US runs a DDA over all
+ *    axes at once, independent of how long a main loop pass takes,
+ *    which keeps the axes synchronized along the path.
+ *  - Blocks are queued into a ring buffer while it plays; an empty
+ *    buffer before the host said `blk end` is an underrun and stops
+ *    the output. A limit switch stops it like any other motion.
+ * ===============================================================
+ */
+
+#ifndef STEPBLOCKS_H_
+#define STEPBLOCKS_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "AxesConfig.h"
+
+#define BLOCK_TICK_US 50        // DDA period (20 kHz); at most one step per axis every other tick
+#define BLOCK_SLOTS   32        // queued blocks, 8 bytes each with three axes
+#define BLOCK_MAX_TICKS 32767   // longest block (1.6 s); keeps the DDA in 16 bits
+
+// Steps in a block never exceed half its ticks: every STEP pulse then has
+// a full tick high and at least one low.
+struct StepBlock {
+	uint16_t ticks;             // duration in BLOCK_TICK_US
+	int16_t  steps[AXIS_COUNT]; // fine steps, the sign is the direction
+};
+
+enum class BlockState : uint8_t {
+	IDLE = 0,       // filling, not started
+	PLAYING,
+	DONE,           // the buffer ran empty after `blk end`
+	UNDERRUN,       // the buffer ran empty before `blk end`
+	HALTED          // a limit switch tripped
+};
+
+class StepperMotors;
+
+class StepBlocks {
+public:
+	static void Begin(StepperMotors *motors);
+
+	// Queue one block; false when the buffer is full.
+	static bool Push(const StepBlock &block);
+	static long Planned(uint8_t axis);         // fine steps once the queued blocks have played
+	static uint8_t Queued();
+	static uint8_t Free() { return BLOCK_SLOTS - 1 - Queued(); }
+
+	static void Start();
+	static void End() { aEnded = true; }       // no more blocks follow
+	static void Clear();                       // stop the output, drop the queue, back to IDLE
+	static void Halt();                        // a limit trip: stop the output, as HALTED
+	static bool Playing() { return aState == BlockState::PLAYING; }
+	static BlockState State() { return aState; }
+	static const __FlashStringHelper *StateName();
+	static uint16_t Played() { return aPlayed; }
+
+	// Folds the steps emitted since the last call into the positions;
+	// runs before StepperMotors::runAll(), and again when it services a
+	// limit trip, so the trip sees them.
+	static void Loop();
+	static int16_t Unfolded(uint8_t axis) { return aMoved[axis]; }  // played, not yet in the position
+	static uint16_t PulseCount(uint8_t axis) { return aPulses[axis]; } // fine steps, wrapping (see Strobe)
+
+	static void Tick();        // Timer3 ISR body
+
+private:
+	struct Output {
+		uint8_t           stepPin;
+		uint8_t           dirPin;
+		volatile uint8_t *stepReg;
+		uint8_t           stepMask;
+		volatile uint8_t *dirReg;
+		uint8_t           dirMask;
+	};
+
+	static StepperMotors *aMotors;
+	static Output     aOutputs[AXIS_COUNT];
+	static StepBlock  aQueue[BLOCK_SLOTS];
+	static volatile uint8_t aHead;          // next block to play (ISR)
+	static volatile uint8_t aTail;          // next free slot (main loop)
+	static volatile BlockState aState;
+	static volatile bool aEnded;
+	static volatile uint16_t aPlayed;
+	static volatile int16_t aMoved[AXIS_COUNT]; // steps not yet folded into the positions
+	static volatile uint16_t aPulses[AXIS_COUNT];
+	static long       aPlanned[AXIS_COUNT];
+
+	// DDA state of the block being played (ISR only)
+	static uint16_t aTicks;
+	static uint16_t aTicksLeft;
+	static uint16_t aRate[AXIS_COUNT];
+	static uint16_t aAcc[AXIS_COUNT];
+	static int8_t   aDir[AXIS_COUNT];
+	static uint8_t  aRaised;                // STEP lines to lower on the next tick
+	static uint8_t  aInverted;              // DIR lines inverted, latched by Start()
+
+	static void stopTimer();
+};
+
+#endif /* STEPBLOCKS_H_ */
@@ -1,192 +1,1064 @@
 #include "StepperMotors.h"
-
-#define STEP_PIN_X    7
-#define DIR_PIN_X     6
-#define ENABLE_PIN_X  5
-#define LIMIT_MIN_X   2
-#define LIMIT_MAX_X   3
-
-#define STEP_PIN_Y    25
-#define DIR_PIN_Y     26
-#define ENABLE_PIN_Y  27
-#define LIMIT_MIN_Y   18
-#define LIMIT_MAX_Y   19
-
-#define STEP_PIN_Z    28
-#define DIR_PIN_Z     29
-#define ENABLE_PIN_Z  30
-#define LIMIT_MIN_Z   20
-#define LIMIT_MAX_Z   21
+#include "JogRecorder.h"
+#include "StepBlocks.h"
 
 // Retraction distance: steps = RETRACT_UNITS * stepsPerUnit
 #define RETRACT_UNITS 25
 
 StepperMotors *StepperMotors::instance = nullptr;
+bool StepperMotors::limitsOnPinChange   = false;
+bool StepperMotors::encodersOnPinChange = false;
+
+// Quadrature transitions indexed by (previous AB << 2) | current AB:
+// +1 / -1 for a valid single step, 0 for no change or a skipped state.
+static const int8_t QUAD_TABLE[16] = {
+     0,  1, -1,  0,
+    -1,  0,  0,  1,
+     1,  0,  0, -1,
+     0, -1,  1,  0
+};
 
 StepperMotors::StepperMotors()
 {
     instance = this;
+    lastEncoderCheckMs = 0;
+    trace = {0, false, 0, 0, 0};
+    estopPending = false;
+    estopUs      = 0;
+
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        const AxisConfig &cfg = AXES_CONFIG[i];
+        motors[i] = cfg.settings;
+        attachMicrostep(i, cfg.microstep);
+        pinMode(cfg.enablePin, OUTPUT);
+        digitalWrite(cfg.enablePin, HIGH); // HIGH = disabled (active-low logic)
+        initializeStepper(i, cfg.stepPin, cfg.dirPin);
+        tracks[i] = {false, false, 0, 0.0f, 0, 0, 0.0f, 0};
+        softLimits[i] = {false, false, 0, 0, 0};
+        targetMu[i]   = 0;
+    }
+
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        attachLimitSwitches(i, AXES_CONFIG[i].minPin, AXES_CONFIG[i].maxPin);
+        attachEncoder(i, AXES_CONFIG[i].encoder);
+    }
+}
+
+StepperMotors::~StepperMotors()
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        delete steppers[i];
+}
+
+int StepperMotors::axisFromName(const char *name)
+{
+    if (name[0] == '\0' || name[1] != '\0')
+        return -1;
+    char c = toupper(name[0]);
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        if (AXES_CONFIG[i].name == c)
+            return i;
+    return -1;
+}
+
+String StepperMotors::axisList()
+{
+    String list;
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if (i) list += '|';
+        list += AXES_CONFIG[i].name;
+    }
+    return list;
+}
 
-    motors[X] = {800.0f, 100.0f, 100, true,  true};
-    motors[Y] = {300.0f,   8.0f,   8, false, true};
-    motors[Z] = {300.0f,   8.0f,   8, true,  true};
+// Fixed-point parse: up to three decimals kept, the fourth rounds.
+long StepperMotors::parseMu(const char *text)
+{
+    bool neg = (*text == '-');
+    if (*text == '-' || *text == '+')
+        text++;
 
-    enablePins[X] = ENABLE_PIN_X;
-    enablePins[Y] = ENABLE_PIN_Y;
-    enablePins[Z] = ENABLE_PIN_Z;
+    long mu = 0;
+    while (isdigit(*text))
+        mu = mu * 10 + (*text++ - '0');
+    mu *= MU_PER_UNIT;
 
-    for (int i = 0; i < 3; ++i) {
-        pinMode(enablePins[i], OUTPUT);
-        digitalWrite(enablePins[i], HIGH); // HIGH = disabled (active-low logic)
+    if (*text == '.') {
+        text++;
+        for (long scale = MU_PER_UNIT / 10; isdigit(*text); text++) {
+            if (scale) {
+                mu += (*text - '0') * scale;
+                scale /= 10;
+            } else {
+                if (*text >= '5')
+                    mu++;
+                break;
+            }
+        }
     }
+    return neg ? -mu : mu;
+}
 
-    initializeStepper(X, STEP_PIN_X, DIR_PIN_X);
-    initializeStepper(Y, STEP_PIN_Y, DIR_PIN_Y);
-    initializeStepper(Z, STEP_PIN_Z, DIR_PIN_Z);
+String StepperMotors::formatMu(long mu)
+{
+    char buf[24];
+    unsigned long a = (mu < 0) ? -mu : mu;
+    snprintf(buf, sizeof(buf), "%s%lu.%03lu", mu < 0 ? "-" : "", a / MU_PER_UNIT, a % MU_PER_UNIT);
+    return String(buf);
+}
 
-    attachLimitSwitches(X, LIMIT_MIN_X, LIMIT_MAX_X);
-    attachLimitSwitches(Y, LIMIT_MIN_Y, LIMIT_MAX_Y);
-    attachLimitSwitches(Z, LIMIT_MIN_Z, LIMIT_MAX_Z);
+GatedStepper::GatedStepper(uint8_t stepPin, uint8_t dirPin)
+    : AccelStepper(AccelStepper::DRIVER, stepPin, dirPin),
+      halted(false), stepsAfterHalt(0), lastStepUs(0), suppressedSteps(0),
+      traceArmed(false), firstStepUs(0), gridOffset(0), pulses(0), pulseShift(0),
+      shaperHz(0.0f), shaperDamping(0.0f), shaperImpulses(2), span(1), tickUs(1),
+      perTickUs(1.0f), sampleUs(0), newest(0), quiet(0), output(0)
+{
 }
 
-StepperMotors::~StepperMotors()
+// Called by AccelStepper::runSpeed() after it has already advanced its position.
+void GatedStepper::step(long step)
 {
-    for (int i = 0; i < 3; i++)
-        delete steppers[i];
+    if (!isShaped())
+        pulse(step);
+}
+
+// One STEP pulse in _direction, unless the limit ISR has halted the axis.
+void GatedStepper::pulse(long step)
+{
+    if (halted) {
+        suppressedSteps += (_direction == DIRECTION_CW) ? 1 : -1;
+        return;
+    }
+
+    AccelStepper::step(step);
+
+    int16_t fine = 1 << pulseShift;
+    noInterrupts();
+    pulses += (_direction == DIRECTION_CW) ? fine : -fine;
+    interrupts();
+
+    if (traceArmed) {
+        firstStepUs = micros();
+        traceArmed  = false;
+    }
+
+    // First pulse after a switch to coarse: the driver has moved onto the
+    // coarse grid, which the position count already assumed.
+    gridOffset = 0;
+
+    // The limit ISR fired while this pulse was going out: record it.
+    if (halted) {
+        lastStepUs = micros();
+        stepsAfterHalt++;
+    }
+}
+
+// ZV: impulses K-weighted at 0 and half a damped period, ZVD: binomial
+// weights at 0, one and two half periods. Both sum to 1, so the motor
+// ends exactly on the reference.
+void GatedStepper::setShaper(float hz, float damping, bool zvd)
+{
+    shaperHz       = constrain(hz, 0.0f, SHAPER_MAX_HZ);
+    shaperDamping  = constrain(damping, 0.0f, 0.9f);
+    shaperImpulses = zvd ? 3 : 2;
+    if (!isShaped())
+        return;
+
+    float wd = sqrtf(1.0f - shaperDamping * shaperDamping);
+    float k  = expf(-shaperDamping * PI / wd);
+    if (zvd) {
+        float n = (1.0f + k) * (1.0f + k);
+        amplitude[0] = 1.0f / n;
+        amplitude[1] = 2.0f * k / n;
+        amplitude[2] = k * k / n;
+    } else {
+        amplitude[0] = 1.0f / (1.0f + k);
+        amplitude[1] = k / (1.0f + k);
+    }
+    span      = (SHAPER_SAMPLES - 1) / (shaperImpulses - 1);
+    tickUs    = max(1UL, (unsigned long)(500000.0f / (shaperHz * wd) / span));
+    perTickUs = 1.0f / tickUs;
+    resync(currentPosition());
+}
+
+// Samples the reference every tick (a late pass repeats the current value)
+// and pulses once toward sum(amplitude[k] * reference(now - k * span ticks)),
+// interpolated between samples. Worked relative to the reference so the
+// floats only ever hold small differences.
+void GatedStepper::runShaper()
+{
+    uint32_t now = micros();
+    long     ref = currentPosition();
+
+    uint32_t late = now - sampleUs;
+    if (late >= tickUs) {
+        uint32_t n = late / tickUs;
+        if (n > SHAPER_SAMPLES) {
+            n        = SHAPER_SAMPLES;
+            sampleUs = now;
+        } else {
+            sampleUs += n * tickUs;
+        }
+        while (n--) {
+            quiet  = (ref == history[newest]) ? min(quiet + 1, 255) : 0;
+            newest = (newest + 1) % SHAPER_SAMPLES;
+            history[newest] = ref;
+        }
+    }
+
+    if (!shaperBusy())
+        return;
+
+    float phase  = (now - sampleUs) * perTickUs;
+    float offset = 0.0f;
+    for (uint8_t k = 1; k < shaperImpulses; k++) {
+        long older = sample(k * span);
+        long newer = sample(k * span - 1);
+        offset += amplitude[k] * ((older - ref) + (newer - older) * phase);
+    }
+    long goal = ref + lround(offset);
+    if (goal == output)
+        return;
+
+    bool saved = _direction;
+    _direction = (goal > output) ? DIRECTION_CW : DIRECTION_CCW;
+    output    += (goal > output) ? 1 : -1;
+    pulse(0);
+    _direction = saved;
+}
+
+bool GatedStepper::shaperBusy()
+{
+    if (!isShaped())
+        return false;
+    long ref = currentPosition();
+    return output != ref || history[newest] != ref || quiet < (shaperImpulses - 1) * span;
+}
+
+void GatedStepper::setCurrentPosition(long position)
+{
+    long shift = position - currentPosition();
+    AccelStepper::setCurrentPosition(position);
+    output += shift;
+    for (uint8_t i = 0; i < SHAPER_SAMPLES; i++)
+        history[i] += shift;
+}
+
+void GatedStepper::resync(long position)
+{
+    AccelStepper::setCurrentPosition(position);
+    output   = position;
+    sampleUs = micros();
+    quiet    = 255;
+    for (uint8_t i = 0; i < SHAPER_SAMPLES; i++)
+        history[i] = position;
 }
 
 void StepperMotors::initializeStepper(Axis axis, uint8_t stepPin, uint8_t dirPin)
 {
-    steppers[axis] = new AccelStepper(AccelStepper::DRIVER, stepPin, dirPin);
-    steppers[axis]->setMaxSpeed(motors[axis].maxSpeed);
-    steppers[axis]->setAcceleration(motors[axis].acceleration);
+    steppers[axis] = new GatedStepper(stepPin, dirPin);
+    applySpeedLimits(axis);
     if (motors[axis].invertDirection)
         steppers[axis]->setPinsInverted(true, false, false);
 }
 
+static uint8_t log2u(uint8_t v)
+{
+    uint8_t n = 0;
+    while (v >>= 1)
+        n++;
+    return n;
+}
+
+// Rounds toward minus / plus infinity (C++ division truncates toward zero).
+static long floorDiv(long a, long b) { return (a >= 0) ? a / b : -((-a + b - 1) / b); }
+static long ceilDiv(long a, long b)  { return -floorDiv(-a, b); }
+
+void StepperMotors::attachMicrostep(Axis axis, const MicrostepConfig &cfg)
+{
+    MicrostepState &ms = microsteps[axis];
+    ms = {0, 0, 0, false, (float)cfg.coarseSpeed, false, 0, 0};
+
+    if (cfg.fine == 0 || log2u(cfg.fine) >= MICROSTEP_MODES)
+        return;
+    ms.fineLog = log2u(cfg.fine);
+    if (cfg.coarse && cfg.coarse < cfg.fine) {
+        ms.coarseShift = ms.fineLog - log2u(cfg.coarse);
+        ms.autoCoarse  = true;
+    }
+
+    const uint8_t pins[3] = { cfg.ms1Pin, cfg.ms2Pin, cfg.ms3Pin };
+    for (uint8_t b = 0; b < 3; b++) {
+        if (pins[b] == NO_PIN)
+            continue;
+        pinMode(pins[b], OUTPUT);
+        digitalWrite(pins[b], (MICROSTEP_PATTERNS[ms.fineLog] >> b) & 1);
+    }
+}
+
+// Switches the driver to fine >> shift microsteps and rescales AccelStepper's
+// count and limits. Only called while the axis stands still. The driver's
+// first pulse in the new mode goes to the next valid position of that mode
+// (its grid runs through gridBase), so from off-grid the count starts at the
+// grid point behind `direction`.
+void StepperMotors::setResolution(Axis axis, uint8_t shift, long direction)
+{
+    MicrostepState &ms = microsteps[axis];
+    GatedStepper   *s  = steppers[axis];
+    if (shift == ms.shift && s->gridOffset == 0)
+        return;
+
+    long pos   = getPosition(axis);
+    long base  = shift ? ms.gridBase : 0;
+    long ratio = 1L << shift;
+    long count = (direction >= 0) ? floorDiv(pos - base, ratio) : ceilDiv(pos - base, ratio);
+
+    if (shift != ms.shift) {
+        const MicrostepConfig &cfg = AXES_CONFIG[axis].microstep;
+        const uint8_t pins[3] = { cfg.ms1Pin, cfg.ms2Pin, cfg.ms3Pin };
+        uint8_t pattern = MICROSTEP_PATTERNS[ms.fineLog - shift];
+        for (uint8_t b = 0; b < 3; b++)
+            if (pins[b] != NO_PIN)
+                digitalWrite(pins[b], (pattern >> b) & 1);
+        ms.shift = shift;
+        s->pulseShift = shift;
+        applySpeedLimits(axis);
+    }
+
+    s->setCurrentPosition(count);
+    s->gridOffset = pos - base - count * ratio;
+}
+
+void StepperMotors::applySpeedLimits(Axis axis)
+{
+    float ratio = (float)(1L << microsteps[axis].shift);
+    steppers[axis]->setMaxSpeed(motors[axis].maxSpeed / ratio);
+    steppers[axis]->setAcceleration(motors[axis].acceleration / ratio);
+}
+
+long StepperMotors::getPosition(Axis axis) const
+{
+    const MicrostepState &ms = microsteps[axis];
+    GatedStepper         *s  = steppers[axis];
+    if (ms.shift == 0)
+        return s->outputPosition();
+    return s->currentPosition() * (1L << ms.shift) + ms.gridBase + s->gridOffset;
+}
+
+float StepperMotors::getSpeed(Axis axis) const
+{
+    return steppers[axis]->speed() * (1L << microsteps[axis].shift);
+}
+
+long StepperMotors::getDistanceToGo(Axis axis) const
+{
+    const MicrostepState &ms = microsteps[axis];
+    GatedStepper         *s  = steppers[axis];
+    if (ms.finishFine)
+        return ms.fineTarget - getPosition(axis);
+    if (ms.shift == 0)
+        return s->targetPosition() - s->outputPosition();
+    return s->targetPosition() * (1L << ms.shift) + ms.gridBase - getPosition(axis);
+}
+
+uint8_t StepperMotors::getMicrosteps(Axis axis) const
+{
+    const MicrostepState &ms = microsteps[axis];
+    return ms.coarseShift ? AXES_CONFIG[axis].microstep.fine >> ms.shift : 0;
+}
+
+// Picks the resolution for a new target. From standstill, a move long enough
+// to pass coarseSpeed runs coarse to the last coarse grid point before the
+// target, and runAll() finishes the remainder fine. A moving axis keeps its
+// resolution.
+void StepperMotors::startMove(Axis axis, long targetSteps)
+{
+    MicrostepState &ms = microsteps[axis];
+    GatedStepper   *s  = steppers[axis];
+    long pos       = getPosition(axis);
+    long direction = (targetSteps >= pos) ? 1 : -1;
+    ms.finishFine  = false;
+
+    if (ms.coarseShift && s->speed() == 0.0f && !s->isShaped()) {
+        const MotorSettings &m = motors[axis];
+        float v    = ms.coarseSpeed;
+        bool  fast = ms.autoCoarse && m.maxSpeed > v &&
+                     labs(targetSteps - pos) > v * v / m.acceleration;
+        setResolution(axis, fast ? ms.coarseShift : 0, direction);
+    }
+
+    if (ms.shift == 0) {
+        s->moveTo(targetSteps);
+        return;
+    }
+
+    long ratio = 1L << ms.shift;
+    long rel   = targetSteps - ms.gridBase;
+    long leg   = (direction > 0) ? floorDiv(rel, ratio) : ceilDiv(rel, ratio);
+    ms.finishFine = (leg * ratio != rel);
+    ms.fineTarget = targetSteps;
+    s->moveTo(leg);
+}
+
 void StepperMotors::attachLimitSwitches(Axis axis, uint8_t minPin, uint8_t maxPin)
 {
-    limitSwitches[axis].minPin        = minPin;
-    limitSwitches[axis].maxPin        = maxPin;
-    limitSwitches[axis].lastTriggerMs = 0;
-    limitSwitches[axis].needsPrint    = false;
-    limitSwitches[axis].limitHit      = false;
-    limitSwitches[axis].isRetracting  = false;
-    limitSwitches[axis].minTriggered  = false;
-    limitSwitches[axis].maxTriggered  = false;
-
-    pinMode(minPin, INPUT_PULLUP);
-    pinMode(maxPin, INPUT_PULLUP);
-
-    switch (axis) {
-    case X:
-        attachInterrupt(digitalPinToInterrupt(minPin), handleInterruptXMin, FALLING);
-        attachInterrupt(digitalPinToInterrupt(maxPin), handleInterruptXMax, FALLING);
-        break;
-    case Y:
-        attachInterrupt(digitalPinToInterrupt(minPin), handleInterruptYMin, FALLING);
-        attachInterrupt(digitalPinToInterrupt(maxPin), handleInterruptYMax, FALLING);
-        break;
-    case Z:
-        attachInterrupt(digitalPinToInterrupt(minPin), handleInterruptZMin, FALLING);
-        attachInterrupt(digitalPinToInterrupt(maxPin), handleInterruptZMax, FALLING);
-        break;
-    }
-}
-
-// Called from ISR — keep it minimal: no Serial, no heap allocation, no blocking calls.
-void StepperMotors::onLimitHit(Axis axis, bool isMin)
-{
-    // Debounce: ignore triggers that arrive too soon after the last one.
-    uint32_t now = millis();
-    if (now - limitSwitches[axis].lastTriggerMs < LIMIT_DEBOUNCE_MS)
+    LimitSwitches &sw = limitSwitches[axis];
+    sw.minPin       = minPin;
+    sw.maxPin       = maxPin;
+    sw.minReg       = (minPin == NO_PIN) ? nullptr : portInputRegister(digitalPinToPort(minPin));
+    sw.maxReg       = (maxPin == NO_PIN) ? nullptr : portInputRegister(digitalPinToPort(maxPin));
+    sw.minMask      = (minPin == NO_PIN) ? 0 : digitalPinToBitMask(minPin);
+    sw.maxMask      = (maxPin == NO_PIN) ? 0 : digitalPinToBitMask(maxPin);
+    sw.triggerUs    = 0;
+    sw.needsService = false;
+    sw.limitHit     = false;
+    sw.isRetracting = false;
+    sw.minTriggered = false;
+    sw.maxTriggered = false;
+    sw.isMinHit     = false;
+
+    limitLatency[axis] = {0, 0, 0, 0, 0};
+
+    attachLimitPin(minPin);
+    attachLimitPin(maxPin);
+}
+
+// Routes one switch pin to handleLimitInterrupt(): its external interrupt when
+// it has one, otherwise its pin-change group (PCINTn_vect below).
+void StepperMotors::attachLimitPin(uint8_t pin)
+{
+    if (pin == NO_PIN)
         return;
-    limitSwitches[axis].lastTriggerMs = now;
 
-    // Update state flags (volatile — safe to write from ISR).
-    limitSwitches[axis].limitHit     = true;
-    limitSwitches[axis].isRetracting = true;
-    if (isMin) limitSwitches[axis].minTriggered = true;
-    else       limitSwitches[axis].maxTriggered = true;
+    pinMode(pin, INPUT_PULLUP);
 
-    // Schedule the serial print for the main loop (Serial is not ISR-safe).
-    limitSwitches[axis].isMinHit   = isMin;
-    limitSwitches[axis].needsPrint = true;
+    if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT) {
+        attachInterrupt(digitalPinToInterrupt(pin), handleLimitInterrupt, FALLING);
+    } else if (digitalPinToPCICR(pin)) {
+        *digitalPinToPCICR(pin) |= bit(digitalPinToPCICRbit(pin));
+        *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+        limitsOnPinChange = true;
+    }
+}
 
-    // Stop and retract. AccelStepper::stop() and move() only set variables —
-    // no blocking I/O — so they are safe to call from an ISR.
-    steppers[axis]->stop();
+void StepperMotors::attachEncoder(Axis axis, const EncoderConfig &cfg)
+{
+    EncoderState &enc = encoders[axis];
+    enc.regA          = nullptr;
+    enc.count         = 0;
+    enc.errorSteps    = 0;
+    enc.stepsPerCount = 0;
+
+    if (cfg.countsPerRev == 0 || cfg.pinA == NO_PIN || cfg.pinB == NO_PIN)
+        return;
+
+    pinMode(cfg.pinA, INPUT_PULLUP);
+    pinMode(cfg.pinB, INPUT_PULLUP);
+
+    enc.maskA         = digitalPinToBitMask(cfg.pinA);
+    enc.maskB         = digitalPinToBitMask(cfg.pinB);
+    enc.regB          = portInputRegister(digitalPinToPort(cfg.pinB));
+    enc.stepsPerCount = (float)cfg.stepsPerRev / cfg.countsPerRev;
+    enc.lastAB        = (digitalRead(cfg.pinA) ? 2 : 0) | (digitalRead(cfg.pinB) ? 1 : 0);
+    enc.regA          = portInputRegister(digitalPinToPort(cfg.pinA));  // last: arms the ISR
 
-    long direction    = isMin ? 1L : -1L;   // move away from the triggered end
+    attachEncoderPin(cfg.pinA);
+    attachEncoderPin(cfg.pinB);
+}
+
+void StepperMotors::attachEncoderPin(uint8_t pin)
+{
+    if (digitalPinToInterrupt(pin) != NOT_AN_INTERRUPT) {
+        attachInterrupt(digitalPinToInterrupt(pin), handleEncoderInterrupt, CHANGE);
+    } else if (digitalPinToPCICR(pin)) {
+        *digitalPinToPCICR(pin) |= bit(digitalPinToPCICRbit(pin));
+        *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+        encodersOnPinChange = true;
+    }
+}
+
+// ISR — decodes every configured encoder from a snapshot of its A/B inputs.
+void StepperMotors::handleEncoderInterrupt()
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        EncoderState &enc = instance->encoders[i];
+        if (!enc.regA)
+            continue;
+
+        uint8_t ab = ((*enc.regA & enc.maskA) ? 2 : 0) | ((*enc.regB & enc.maskB) ? 1 : 0);
+        enc.count += QUAD_TABLE[(enc.lastAB << 2) | ab];
+        enc.lastAB = ab;
+    }
+}
+
+// Pin-change groups fire on both edges and are shared by limit switches and
+// encoders; the limit handler only latches LOW pins.
+void StepperMotors::handlePinChange()
+{
+    if (encodersOnPinChange) handleEncoderInterrupt();
+    if (limitsOnPinChange)   handleLimitInterrupt();
+}
+
+// Pin-change group of a pin as the Mega core maps it (digitalPinToPCICRbit),
+// or -1; external-interrupt pins have none, so they never land here.
+static constexpr int pcintGroup(uint8_t pin)
+{
+    return ((pin >= 10 && pin <= 13) || (pin >= 50 && pin <= 53)) ? 0 :
+           (pin == 14 || pin == 15)                               ? 1 :
+           (pin >= 62 && pin <= 69)                               ? 2 : -1;
+}
+
+static constexpr uint8_t pcintBit(uint8_t pin)
+{
+    return pcintGroup(pin) < 0 ? 0 : 1 << pcintGroup(pin);
+}
+
+static constexpr uint8_t pcintGroupsUsed(uint8_t i = 0)
+{
+    return i >= AXIS_COUNT ? 0 :
+           pcintBit(AXES_CONFIG[i].minPin) | pcintBit(AXES_CONFIG[i].maxPin) |
+           (AXES_CONFIG[i].encoder.countsPerRev && AXES_CONFIG[i].encoder.pinA != NO_PIN &&
+                    AXES_CONFIG[i].encoder.pinB != NO_PIN ?
+                pcintBit(AXES_CONFIG[i].encoder.pinA) | pcintBit(AXES_CONFIG[i].encoder.pinB) : 0) |
+           pcintGroupsUsed(i + 1);
+}
+
+static_assert((pcintGroupsUsed() & ~AXES_PCINT_VECTORS) == 0,
+              "AXES_CONFIG has a pin-change pin whose group is not in AXES_PCINT_VECTORS");
+
+// Only the groups asked for, so the others stay free for other libraries.
+#if AXES_PCINT_VECTORS & 0b001
+ISR(PCINT0_vect) { StepperMotors::handlePinChange(); }
+#endif
+#if AXES_PCINT_VECTORS & 0b010
+ISR(PCINT1_vect) { StepperMotors::handlePinChange(); }
+#endif
+#if AXES_PCINT_VECTORS & 0b100
+ISR(PCINT2_vect) { StepperMotors::handlePinChange(); }
+#endif
+
+// ISR — keep it minimal: no Serial, no heap allocation, no AccelStepper calls.
+// Only gates the STEP output; deceleration reset and retract happen in runAll().
+void StepperMotors::handleLimitInterrupt()
+{
+    uint32_t now = micros();
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        LimitSwitches &sw = instance->limitSwitches[i];
+
+        // Switches are active-low (INPUT_PULLUP).
+        bool minLow = sw.minReg && !(*sw.minReg & sw.minMask);
+        bool maxLow = sw.maxReg && !(*sw.maxReg & sw.maxMask);
+        if (!minLow && !maxLow)
+            continue;
+
+        // Already latched (retract pending or running), or a bounce.
+        if (sw.limitHit || now - sw.triggerUs < LIMIT_DEBOUNCE_MS * 1000UL)
+            continue;
+
+        GatedStepper *s = instance->steppers[i];
+        s->stepsAfterHalt = 0;
+        s->halted         = true;
+
+        sw.triggerUs    = now;
+        sw.limitHit     = true;
+        sw.isRetracting = true;
+        sw.isMinHit     = minLow;
+        if (minLow) sw.minTriggered = true;
+        else        sw.maxTriggered = true;
+        sw.needsService = true;
+    }
+}
+
+// ISR, like handleLimitInterrupt(): the gate stops the pulses of AccelStepper
+// and of a step-block playback (its next tick sees the halt); the enable
+// lines go high (disabled) straight away.
+void StepperMotors::handleEmergencyStop()
+{
+    if (!instance)
+        return;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        GatedStepper *s = instance->steppers[i];
+        s->stepsAfterHalt = 0;
+        s->halted         = true;
+        digitalWrite(AXES_CONFIG[i].enablePin, HIGH);
+    }
+    if (!instance->estopPending)
+        instance->estopUs = micros();
+    instance->estopPending = true;
+}
+
+// Main-loop half of an emergency stop: every axis is resynced to its last
+// real pulse, at rest and disabled. A limit retract not yet started is dropped.
+uint32_t StepperMotors::serviceEmergencyStop()
+{
+    noInterrupts();
+    uint32_t tripUs = estopUs;
+    estopPending = false;
+    interrupts();
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        GatedStepper *s = steppers[i];
+        s->resync(s->outputPosition() - s->suppressedSteps);
+        s->suppressedSteps = 0;
+        microsteps[i].finishFine = false;
+        setResolution(i, 0);
+        tracks[i].active = false;
+        limitSwitches[i].needsService = false;
+        softLimits[i].clamped = 0;
+        setEnabled(i, false);
+        s->halted = false;
+    }
+
+    uint32_t us = micros() - tripUs;
+    EventLog::Record(EV_ESTOP, EVENT_NO_AXIS, (int32_t)us);
+    return us;
+}
+
+// Main-loop half of a limit trip: record latency, drop the suppressed steps,
+// queue the retract and release the STEP gate.
+void StepperMotors::serviceLimitHit(Axis axis)
+{
+    LimitSwitches &sw = limitSwitches[axis];
+    GatedStepper  *s  = steppers[axis];
+    LimitLatency  &lat = limitLatency[axis];
+
+    uint8_t  steps = s->stepsAfterHalt;
+    uint32_t us    = steps ? s->lastStepUs - sw.triggerUs : 0;
+    lat.trips++;
+    lat.lastSteps = steps;
+    lat.lastUs    = us;
+    if (steps > lat.worstSteps) lat.worstSteps = steps;
+    if (us > lat.worstUs)       lat.worstUs    = us;
+
+    // Block pulses played since this pass's StepBlocks::Loop() are part of
+    // where the axis stopped: fold them in before the switch is recorded.
+    StepBlocks::Halt();
+    StepBlocks::Loop();
+
+    // Resync to the last pulse that really went out; this also zeroes the speed.
+    s->resync(s->outputPosition() - s->suppressedSteps);
+    s->suppressedSteps = 0;
+    microsteps[axis].finishFine = false;
+    setResolution(axis, 0);
+
+    // Where this switch really is: the soft limit on that end follows it.
+    SoftLimits &soft = softLimits[axis];
+    if (sw.isMinHit) {
+        soft.minKnown       = true;
+        soft.minSwitchSteps = s->currentPosition();
+    } else {
+        soft.maxKnown       = true;
+        soft.maxSwitchSteps = s->currentPosition();
+    }
+    soft.clamped = 0;
+
+    long direction    = sw.isMinHit ? 1L : -1L;   // move away from the triggered end
     long retractSteps = direction * (long)motors[axis].stepsPerUnit * RETRACT_UNITS;
 
     setEnabled(axis, true);
-    steppers[axis]->move(retractSteps);
+    tracks[axis].active = false;
+    s->move(retractSteps);
+    EventLog::Record(EV_LIMIT, axis, sw.isMinHit ? 1 : 0);
+    s->halted = false;
 }
 
-// ISR delegates — one per switch pin.
-void StepperMotors::handleInterruptXMin() { instance->onLimitHit(X, true);  }
-void StepperMotors::handleInterruptXMax() { instance->onLimitHit(X, false); }
-void StepperMotors::handleInterruptYMin() { instance->onLimitHit(Y, true);  }
-void StepperMotors::handleInterruptYMax() { instance->onLimitHit(Y, false); }
-void StepperMotors::handleInterruptZMin() { instance->onLimitHit(Z, true);  }
-void StepperMotors::handleInterruptZMax() { instance->onLimitHit(Z, false); }
-
 // Called every main loop iteration — drives all steppers and handles post-ISR work.
 void StepperMotors::runAll()
 {
-    for (int i = 0; i < 3; i++) {
-        steppers[i]->run();
+    uint32_t now = millis();
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        // Limit tripped since the last pass: retract and report (safe here in main loop).
+        if (limitSwitches[i].needsService) {
+            limitSwitches[i].needsService = false;
+            serviceLimitHit(i);
 
-        // Print limit-hit message deferred from the ISR (safe here in main loop).
-        if (limitSwitches[i].needsPrint) {
-            limitSwitches[i].needsPrint = false;
-            const char *axisName = (i == X) ? "X" : (i == Y) ? "Y" : "Z";
             MegaBoard::Print("^");
-            MegaBoard::Print(axisName);
+            MegaBoard::Print(axisName(i));
             MegaBoard::Print(limitSwitches[i].isMinHit ? "MIN" : "MAX");
             MegaBoard::Println(": [RETRACT]");
         }
 
+        if (tracks[i].active) {
+            if (now - tracks[i].lastUpdateMs >= TRACK_UPDATE_MS)
+                updateTracking(i, now);
+            steppers[i]->runSpeed();
+        } else {
+            steppers[i]->run();
+        }
+        if (steppers[i]->isShaped())
+            steppers[i]->runShaper();
+
+        // Coarse leg over: back to fine resolution, then the remainder.
+        MicrostepState &ms = microsteps[i];
+        if (ms.shift && !tracks[i].active && steppers[i]->distanceToGo() == 0 &&
+            steppers[i]->speed() == 0.0f) {
+            setResolution(i, 0);
+            if (ms.finishFine) {
+                ms.finishFine = false;
+                steppers[i]->moveTo(ms.fineTarget);
+            }
+        }
+
+        // A move cut short by a soft limit has arrived there.
+        if (softLimits[i].clamped && !isRunning(i)) {
+            MegaBoard::Print("^SOFTLIMIT [Axis ");
+            MegaBoard::Print(axisName(i));
+            MegaBoard::Println(softLimits[i].clamped < 0 ? ": min]" : ": max]");
+            softLimits[i].clamped = 0;
+        }
+
         // Retraction complete: disable that axis and clear flags.
-        if (limitSwitches[i].isRetracting && steppers[i]->distanceToGo() == 0) {
+        if (limitSwitches[i].isRetracting && !limitSwitches[i].needsService && !isRunning(i)) {
             limitSwitches[i].isRetracting = false;
-            limitSwitches[i].limitHit     = false;
             limitSwitches[i].minTriggered = false;
             limitSwitches[i].maxTriggered = false;
-            setEnabled(static_cast<Axis>(i), false);
+            limitSwitches[i].limitHit     = false;
+            setEnabled(i, false);
+            EventLog::Record(EV_RETRACT_DONE, i);
 
-            const char *axisName = (i == X) ? "X" : (i == Y) ? "Y" : "Z";
             MegaBoard::Print("^SECURITY [Axis ");
-            MegaBoard::Print(axisName);
+            MegaBoard::Print(axisName(i));
             MegaBoard::Println(": retract complete, motor disabled]");
         }
     }
+
+    checkEncoders();
+
+    if (trace.pending)
+        reportTrace();
+}
+
+void StepperMotors::traceFirstStep(int axis, uint16_t id, uint32_t rxUs, uint32_t dispatchUs)
+{
+    trace = {id, true, rxUs, dispatchUs, 0};
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        steppers[i]->traceArmed  = (axis < 0 || i == axis);
+        steppers[i]->firstStepUs = 0;
+    }
+}
+
+// First armed axis that has pulsed closes the trace: ^TRACE with the
+// dispatch and first-step times relative to the start of the command line.
+void StepperMotors::reportTrace()
+{
+    int first = -1;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        const GatedStepper *s = steppers[i];
+        if (s->traceArmed || s->firstStepUs == 0)
+            continue;
+        if (first < 0 || (int32_t)(s->firstStepUs - steppers[first]->firstStepUs) < 0)
+            first = i;
+    }
+    if (first < 0)
+        return;
+
+    trace.pending = false;
+    trace.stepUs  = steppers[first]->firstStepUs;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        steppers[i]->traceArmed  = false;
+        steppers[i]->firstStepUs = 0;
+    }
+
+    MegaBoard::Print("^TRACE [id=");
+    MegaBoard::Print(trace.id);
+    MegaBoard::Print(" rx=");
+    MegaBoard::Print(trace.rxUs);
+    MegaBoard::Print(" dispatch=+");
+    MegaBoard::Print(trace.dispatchUs - trace.rxUs);
+    MegaBoard::Print(" step=+");
+    MegaBoard::Print(trace.stepUs - trace.rxUs);
+    MegaBoard::Println("]");
+}
+
+// Compares each encoder against the commanded position. A gap beyond the
+// axis' stallSteps means lost steps: stop the axis where it really is. The
+// stop is immediate, with no ramp: the motor has already fallen out of step
+// with the pulses, so decelerating would only command more steps it does not
+// follow. A disabled axis holds nothing and may be moved by hand; its
+// position follows the encoder there without ^STALL.
+void StepperMotors::checkEncoders()
+{
+    uint32_t now = millis();
+    if (now - lastEncoderCheckMs < ENCODER_CHECK_MS)
+        return;
+    lastEncoderCheckMs = now;
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        if (!hasEncoder(i) || limitSwitches[i].needsService)
+            continue;
+
+        EncoderState &enc = encoders[i];
+        long measured  = lround(getEncoderCount(i) * enc.stepsPerCount);
+        enc.errorSteps = getPosition(i) - measured;
+        if (labs(enc.errorSteps) <= AXES_CONFIG[i].encoder.stallSteps)
+            continue;
+
+        // Resync to the measured position; this also zeroes speed and target.
+        // The driver did not move with it, so its grid keeps its place.
+        tracks[i].active = false;
+        microsteps[i].finishFine = false;
+        setResolution(i, 0);
+        microsteps[i].gridBase -= enc.errorSteps;
+        steppers[i]->resync(measured);
+        if (!isEnabled(i)) {
+            enc.errorSteps = 0;
+            continue;
+        }
+        EventLog::Record(EV_STALL, i, enc.errorSteps);
+
+        MegaBoard::Print("^STALL [Axis ");
+        MegaBoard::Print(axisName(i));
+        MegaBoard::Print(": error=");
+        MegaBoard::Print(enc.errorSteps);
+        MegaBoard::Println(" steps]");
+    }
+}
+
+long StepperMotors::getEncoderCount(Axis axis) const
+{
+    noInterrupts();
+    long count = encoders[axis].count;
+    interrupts();
+    return count;
 }
 
 bool StepperMotors::isRunning(Axis axis) const
 {
-    return steppers[axis]->distanceToGo() != 0;
+    return tracks[axis].active || getDistanceToGo(axis) != 0 || steppers[axis]->shaperBusy();
+}
+
+bool StepperMotors::isAnyRunning() const
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i)
+        if (isRunning(i))
+            return true;
+    return false;
+}
+
+void StepperMotors::trackTo(Axis axis, long mu)
+{
+    TrackState &t      = tracks[axis];
+    long        target = muToSteps(axis, mu);
+    uint32_t    now    = millis();
+
+    if (t.active && !t.stopping) {
+        uint32_t dt = now - t.setpointMs;
+        t.velocity = (dt > 0 && dt <= TRACK_TIMEOUT_MS)
+                   ? (target - t.targetSteps) * 1000.0f / dt
+                   : 0.0f;
+    } else if (!t.active) {
+        // Take over from whatever profile was running, without a jerk.
+        t.velocity     = 0.0f;
+        t.speed        = getSpeed(axis);
+        t.lastUpdateMs = now;
+        t.active       = true;
+        microsteps[axis].finishFine = false;
+    }
+
+    t.stopping    = false;
+    t.targetSteps = target;
+    t.setpointMs  = now;
+}
+
+void StepperMotors::endTracking(Axis axis)
+{
+    if (tracks[axis].active)
+        tracks[axis].stopping = true;
+}
+
+// Velocity feed-forward from the setpoint stream plus a P term on the
+// extrapolated target, capped by maxSpeed, by the speed from which the axis can
+// still stop at the target, and slewed by the configured acceleration.
+void StepperMotors::updateTracking(Axis axis, uint32_t now)
+{
+    TrackState &t     = tracks[axis];
+    float       dt    = (now - t.lastUpdateMs) * 0.001f;
+    float       accel = motors[axis].acceleration;
+    float       desired = 0.0f;
+    t.lastUpdateMs = now;
+
+    if (!t.stopping) {
+        uint32_t age   = now - t.setpointMs;
+        float    ahead = t.velocity * min(age, (uint32_t)TRACK_TIMEOUT_MS) * 0.001f;
+        float    ff    = (age <= TRACK_TIMEOUT_MS) ? t.velocity : 0.0f;
+
+        // Hold at a soft limit rather than keep feeding the setpoint velocity.
+        long aim = t.targetSteps + lround(ahead);
+        long safe = clampToSoftLimits(axis, aim);
+        if (safe != aim)
+            ff = 0.0f;
+
+        t.errorSteps = safe - getPosition(axis);
+
+        float err  = (float)t.errorSteps;
+        float corr = min(TRACK_GAIN * fabs(err), sqrtf(2.0f * accel * fabs(err)));
+        desired = ff + (err < 0 ? -corr : corr);
+        desired = constrain(desired, -motors[axis].maxSpeed, motors[axis].maxSpeed);
+    }
+
+    float maxDelta = accel * dt;
+    t.speed = constrain(desired, t.speed - maxDelta, t.speed + maxDelta);
+
+    if (t.stopping && t.speed == 0.0f) {
+        t.active = false;
+        steppers[axis]->setCurrentPosition(steppers[axis]->currentPosition());
+        return;
+    }
+
+    steppers[axis]->setSpeed(t.speed / (1L << microsteps[axis].shift));
+}
+
+// Limits a target to the soft travel range. An axis already outside it
+// (e.g. right after a trip) may move back in but never further out.
+long StepperMotors::clampToSoftLimits(Axis axis, long targetSteps, int8_t *side) const
+{
+    const SoftLimits &soft = softLimits[axis];
+    long margin = lround(motors[axis].softMargin * motors[axis].stepsPerUnit);
+    long pos    = getPosition(axis);
+
+    if (side)
+        *side = 0;
+    if (motors[axis].softMargin <= 0.0f)
+        return targetSteps;
+
+    if (soft.minKnown) {
+        long lo = min(soft.minSwitchSteps + margin, pos);
+        if (targetSteps < lo) {
+            targetSteps = lo;
+            if (side) *side = -1;
+        }
+    }
+    if (soft.maxKnown) {
+        long hi = max(soft.maxSwitchSteps - margin, pos);
+        if (targetSteps > hi) {
+            targetSteps = hi;
+            if (side) *side = 1;
+        }
+    }
+    return targetSteps;
+}
+
+void StepperMotors::forgetSoftLimits(Axis axis)
+{
+    softLimits[axis] = {false, false, 0, 0, 0};
+}
+
+// Fills the fields one by one: the snapshot is compared bytewise, so its
+// padding (host builds) must stay as it was.
+void StepperMotors::snapshot(Axis axis, AxisSnapshot &snap) const
+{
+    const SoftLimits &soft = softLimits[axis];
+    snap.steps          = getPosition(axis);
+    snap.targetMu       = targetMu[axis];
+    snap.gridBase       = microsteps[axis].gridBase;
+    snap.minSwitchSteps = soft.minSwitchSteps;
+    snap.maxSwitchSteps = soft.maxSwitchSteps;
+    snap.flags          = (soft.minKnown ? WARM_MIN_KNOWN : 0) |
+                          (soft.maxKnown ? WARM_MAX_KNOWN : 0) |
+                          (isRunning(axis) ? WARM_MOVING : 0);
+}
+
+// Only called at boot, with the axis at rest in fine resolution. After a
+// power cycle (driverReset) the stage may have been moved by hand, so the
+// switch positions are dropped and relearned at the next trip.
+void StepperMotors::restore(Axis axis, const AxisSnapshot &snap, bool driverReset)
+{
+    steppers[axis]->setCurrentPosition(snap.steps);
+    targetMu[axis]            = snap.targetMu;
+    microsteps[axis].gridBase = driverReset ? snap.steps : snap.gridBase;
+    softLimits[axis] = {!driverReset && (snap.flags & WARM_MIN_KNOWN) != 0,
+                        !driverReset && (snap.flags & WARM_MAX_KNOWN) != 0,
+                        snap.minSwitchSteps, snap.maxSwitchSteps, 0};
+    syncEncoder(axis, snap.steps);
+}
+
+// Nearest step, rounding half away from zero. 64-bit product: run targets
+// (1e8 mu) times stepsPerUnit overflow 32 bits. Only used per command.
+long StepperMotors::muToSteps(Axis axis, long mu) const
+{
+    int64_t p = (int64_t)mu * motors[axis].stepsPerUnit;
+    return (long)((p >= 0 ? p + MU_PER_UNIT / 2 : p - MU_PER_UNIT / 2) / MU_PER_UNIT);
 }
 
-void StepperMotors::moveTo(Axis axis, long units)
+long StepperMotors::stepsToMu(Axis axis, long steps) const
 {
-    steppers[axis]->moveTo(units * motors[axis].stepsPerUnit);
+    return (long)((int64_t)steps * MU_PER_UNIT / motors[axis].stepsPerUnit);
 }
 
-void StepperMotors::moveRelative(Axis axis, long units)
+void StepperMotors::moveTo(Axis axis, long mu)
 {
-    steppers[axis]->move((long)units * motors[axis].stepsPerUnit);
+    tracks[axis].active = false;
+    long steps  = muToSteps(axis, mu);
+    long target = clampToSoftLimits(axis, steps, &softLimits[axis].clamped);
+    targetMu[axis] = (target == steps) ? mu : stepsToMu(axis, target);
+    startMove(axis, target);
 }
 
-void StepperMotors::setCurrentPosition(Axis axis, long units)
+void StepperMotors::moveRelative(Axis axis, long mu)
 {
-    steppers[axis]->setCurrentPosition(units * motors[axis].stepsPerUnit);
+    // Sitting on the last commanded target: continue from its exact value.
+    // Anywhere else (stopped early, limit resync, tracking): from here.
+    long pos  = getPosition(axis);
+    long base = (pos == muToSteps(axis, targetMu[axis])) ? targetMu[axis] : stepsToMu(axis, pos);
+    moveTo(axis, base + mu);
+}
+
+void StepperMotors::setCurrentPosition(Axis axis, long mu)
+{
+    long steps = muToSteps(axis, mu);
+    targetMu[axis] = mu;
+    tracks[axis].active = false;
+    microsteps[axis].finishFine = false;
+    setResolution(axis, 0);
+    long shift = steps - getPosition(axis);
+    steppers[axis]->setCurrentPosition(steps);
+    microsteps[axis].gridBase += shift;
+
+    // The learned switch positions move with the new origin.
+    softLimits[axis].minSwitchSteps += shift;
+    softLimits[axis].maxSwitchSteps += shift;
+
+    syncEncoder(axis, steps);
+}
+
+void StepperMotors::addSteps(Axis axis, long steps)
+{
+    GatedStepper *s = steppers[axis];
+    long target   = s->targetPosition();
+    bool moving   = s->distanceToGo() != 0;
+    long position = getPosition(axis) + steps;
+    s->resync(position);
+
+    // A move under way (a limit retract) keeps its target.
+    if (moving)
+        s->moveTo(target);
+    else
+        targetMu[axis] = stepsToMu(axis, position);
+}
+
+// Keeps the encoder on the same reference as the commanded position.
+void StepperMotors::syncEncoder(Axis axis, long steps)
+{
+    if (!hasEncoder(axis))
+        return;
+    long count = lround(steps / encoders[axis].stepsPerCount);
+    noInterrupts();
+    encoders[axis].count = count;
+    interrupts();
+    encoders[axis].errorSteps = 0;
 }
 
 void StepperMotors::stop(Axis axis)
 {
-    steppers[axis]->stop();
+    softLimits[axis].clamped = 0;
+    microsteps[axis].finishFine = false;
+    if (tracks[axis].active)
+        endTracking(axis);
+    else
+        steppers[axis]->stop();
 }
 
 MotorSettings StepperMotors::getMotorSettings(Axis axis) const
@@ -197,21 +1069,20 @@ MotorSettings StepperMotors::getMotorSettings(Axis axis) const
 void StepperMotors::setMotorSettings(Axis axis, const MotorSettings &settings)
 {
     motors[axis] = settings;
-    steppers[axis]->setMaxSpeed(settings.maxSpeed);
-    steppers[axis]->setAcceleration(settings.acceleration);
+    applySpeedLimits(axis);
     steppers[axis]->setPinsInverted(settings.invertDirection, false, false);
 }
 
 void StepperMotors::setMaxSpeed(Axis axis, float maxSpeed)
 {
     motors[axis].maxSpeed = maxSpeed;
-    steppers[axis]->setMaxSpeed(maxSpeed);
+    applySpeedLimits(axis);
 }
 
 void StepperMotors::setAcceleration(Axis axis, float acceleration)
 {
     motors[axis].acceleration = acceleration;
-    steppers[axis]->setAcceleration(acceleration);
+    applySpeedLimits(axis);
 }
 
 void StepperMotors::setStepsPerUnit(Axis axis, uint16_t steps)
@@ -227,8 +1098,10 @@ void StepperMotors::setInverted(Axis axis, bool inverted)
 
 void StepperMotors::setEnabled(Axis axis, bool enabled)
 {
+    if (motors[axis].enable != enabled)
+        EventLog::Record(enabled ? EV_ENABLE : EV_DISABLE, axis);
     motors[axis].enable = enabled;
-    digitalWrite(enablePins[axis], enabled ? LOW : HIGH);
+    digitalWrite(AXES_CONFIG[axis].enablePin, enabled ? LOW : HIGH);
 }
 
 bool StepperMotors::isLimitReached(Axis axis, bool minLimit) const
@@ -239,9 +1112,8 @@ bool StepperMotors::isLimitReached(Axis axis, bool minLimit) const
 
 bool StepperMotors::limitTriggered() const
 {
-    for (int i = 0; i < 3; ++i) {
-        if (digitalRead(limitSwitches[i].minPin) == LOW ||
-            digitalRead(limitSwitches[i].maxPin) == LOW)
+    for (uint8_t i = 0; i < AXIS_COUNT; ++i) {
+        if (limitTriggered(i))
             return true;
     }
     return false;
@@ -252,21 +1124,24 @@ bool StepperMotors::isRetracting(Axis axis) const
     return limitSwitches[axis].isRetracting;
 }
 
-String StepperMotors::toJson(Axis axis)
+LimitLatency StepperMotors::getLimitLatency(Axis axis) const
 {
-    const MotorSettings &m  = instance->motors[axis];
-    const LimitSwitches &sw = instance->limitSwitches[axis];
-    uint8_t stepPin = 0, dirPin = 0;
-    uint8_t enablePin = instance->enablePins[axis];
+    return limitLatency[axis];
+}
 
-    switch (axis) {
-    case X: stepPin = STEP_PIN_X; dirPin = DIR_PIN_X; break;
-    case Y: stepPin = STEP_PIN_Y; dirPin = DIR_PIN_Y; break;
-    case Z: stepPin = STEP_PIN_Z; dirPin = DIR_PIN_Z; break;
-    }
+String StepperMotors::toJson(Axis axis)
+{
+    const MotorSettings &m   = instance->motors[axis];
+    const LimitSwitches &sw  = instance->limitSwitches[axis];
+    const SoftLimits    &soft = instance->softLimits[axis];
+    const MicrostepState &ms = instance->microsteps[axis];
+    const AxisConfig    &cfg = AXES_CONFIG[axis];
+    uint8_t stepPin   = cfg.stepPin;
+    uint8_t dirPin    = cfg.dirPin;
+    uint8_t enablePin = cfg.enablePin;
 
     String json = "{\n";
-    json += "  \"axis\": \""      + String(axis == X ? "X" : axis == Y ? "Y" : "Z") + "\",\n";
+    json += "  \"axis\": \""      + String(cfg.name) + "\",\n";
     json += "  \"motor\": {\n";
     json += "    \"maxSpeed\": "      + String(m.maxSpeed)         + ",\n";
     json += "    \"acceleration\": "  + String(m.acceleration)     + ",\n";
@@ -277,11 +1152,39 @@ String StepperMotors::toJson(Axis axis)
     json += "    \"dirPin\": "        + String(dirPin)             + ",\n";
     json += "    \"enablePin\": "     + String(enablePin)          + "\n";
     json += "  },\n";
+    if (instance->hasEncoder(axis)) {
+        json += "  \"encoder\": {\n";
+        json += "    \"count\": "       + String(instance->getEncoderCount(axis))  + ",\n";
+        json += "    \"errorSteps\": "  + String(instance->getPositionError(axis)) + "\n";
+        json += "  },\n";
+    }
+    if (ms.coarseShift) {
+        json += "  \"microstep\": {\n";
+        json += "    \"fine\": "        + String(cfg.microstep.fine)   + ",\n";
+        json += "    \"coarse\": "      + String(cfg.microstep.coarse) + ",\n";
+        json += "    \"current\": "     + String(instance->getMicrosteps(axis)) + ",\n";
+        json += "    \"auto\": "        + String(ms.autoCoarse ? "true" : "false") + ",\n";
+        json += "    \"coarseSpeed\": " + String(ms.coarseSpeed)      + "\n";
+        json += "  },\n";
+    }
+    if (instance->steppers[axis]->isShaped()) {
+        const GatedStepper *s = instance->steppers[axis];
+        json += "  \"shaper\": {\n";
+        json += "    \"type\": \""     + String(s->isShaperZvd() ? "zvd" : "zv") + "\",\n";
+        json += "    \"hz\": "         + String(s->getShaperHz())      + ",\n";
+        json += "    \"damping\": "    + String(s->getShaperDamping()) + "\n";
+        json += "  },\n";
+    }
     json += "  \"limitSwitches\": {\n";
     json += "    \"minPin\": "        + String(sw.minPin)          + ",\n";
     json += "    \"maxPin\": "        + String(sw.maxPin)          + ",\n";
     json += "    \"minTriggered\": "  + String(sw.minTriggered ? "true" : "false") + ",\n";
     json += "    \"maxTriggered\": "  + String(sw.maxTriggered ? "true" : "false") + "\n";
+    json += "  },\n";
+    json += "  \"softLimits\": {\n";
+    json += "    \"margin\": "        + String(m.softMargin)       + ",\n";
+    json += "    \"minSwitch\": "     + (soft.minKnown ? String(soft.minSwitchSteps) : String("null")) + ",\n";
+    json += "    \"maxSwitch\": "     + (soft.maxKnown ? String(soft.maxSwitchSteps) : String("null")) + "\n";
     json += "  }\n}\n";
     return json;
 }
@@ -289,22 +1192,24 @@ String StepperMotors::toJson(Axis axis)
 void StepperMotors::axisCallback(int arg_cnt, char **args)
 {
     if (arg_cnt < 2) {
-        MegaBoard::Println("Usage: axe <X|Y|Z> [param=value ...]");
+        Cmd::Refuse();
+        MegaBoard::Println("Usage: axe <" + axisList() + "> [param=value ...]");
         return;
     }
 
-    char axisChar = toupper(args[1][0]);
-    Axis axis;
-    switch (axisChar) {
-    case 'X': axis = X; break;
-    case 'Y': axis = Y; break;
-    case 'Z': axis = Z; break;
-    default:
-        MegaBoard::Println("Invalid axis. Use X, Y or Z.");
+    int found = axisFromName(args[1]);
+    if (found < 0) {
+        Cmd::Refuse();
+        MegaBoard::Println("Invalid axis. Use " + axisList() + ".");
         return;
     }
+    Axis axis = found;
 
     MotorSettings current = instance->motors[axis];
+    GatedStepper *s       = instance->steppers[axis];
+    float shaperHz        = s->getShaperHz();
+    float shaperDamping   = s->getShaperDamping();
+    bool  shaperZvd       = s->isShaperZvd();
 
     for (int i = 2; i < arg_cnt; i++) {
         String arg = String(args[i]);
@@ -318,9 +1223,29 @@ void StepperMotors::axisCallback(int arg_cnt, char **args)
         else if (key == "stepsPerUnit") current.stepsPerUnit   = (uint16_t)val.toInt();
         else if (key == "inverted")     current.invertDirection = (val == "true");
         else if (key == "enabled")      current.enable          = (val == "true");
+        else if (key == "softMargin")   current.softMargin      = val.toFloat();
+        else if (key == "softLimits" && val == "forget") instance->forgetSoftLimits(axis);
+        else if (key == "microstep")    instance->microsteps[axis].autoCoarse  = (val == "auto");
+        else if (key == "coarseSpeed")  instance->microsteps[axis].coarseSpeed = val.toFloat();
+        else if (key == "shaperHz")     shaperHz      = val.toFloat();
+        else if (key == "shaperDamping") shaperDamping = val.toFloat();
+        else if (key == "shaper")       shaperZvd     = (val == "zvd");
+    }
+
+    // The shaper restarts from the current position: only at rest.
+    if (shaperHz != s->getShaperHz() || shaperDamping != s->getShaperDamping() ||
+        shaperZvd != s->isShaperZvd()) {
+        if (instance->isRunning(axis)) {
+            Cmd::Refuse();
+            MegaBoard::Println("[AXE] Axis is moving, shaper unchanged.");
+            return;
+        }
+        s->setShaper(shaperHz, shaperDamping, shaperZvd);
     }
 
     if (arg_cnt > 2) {
+        if (current.maxSpeed != instance->motors[axis].maxSpeed)
+            JogRecorder::Speed(axis, current.maxSpeed);
         instance->setMotorSettings(axis, current);
         MegaBoard::Println("[AXE] Updated.");
     } else {
@@ -328,8 +1253,29 @@ void StepperMotors::axisCallback(int arg_cnt, char **args)
     }
 }
 
+// Usage: limits — per-axis trip count and STEP pulses / time after the ISR.
+void StepperMotors::limitsCallback(int arg_cnt, char **args)
+{
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        LimitLatency lat = instance->getLimitLatency(i);
+        String line = String(axisName(i));
+        line += " trips="      + String(lat.trips);
+        line += " lastSteps="  + String(lat.lastSteps);
+        line += " lastUs="     + String(lat.lastUs);
+        line += " worstSteps=" + String(lat.worstSteps);
+        line += " worstUs="    + String(lat.worstUs);
+        if (i < AXIS_COUNT - 1) {
+            MegaBoard::Print(line);
+            MegaBoard::Println();
+        } else {
+            MegaBoard::Println(line);
+        }
+    }
+}
+
 bool StepperMotors::limitTriggered(Axis axis) const
 {
-    return digitalRead(limitSwitches[axis].minPin) == LOW ||
-           digitalRead(limitSwitches[axis].maxPin) == LOW;
+    const LimitSwitches &sw = limitSwitches[axis];
+    return (sw.minReg && !(*sw.minReg & sw.minMask)) ||
+           (sw.maxReg && !(*sw.maxReg & sw.maxMask));
 }
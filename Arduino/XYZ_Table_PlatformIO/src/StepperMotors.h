@@ -4,39 +4,201 @@
 #include <Arduino.h>
 #include <AccelStepper.h>
 #include "MegaBoard.h"
+#include "AxesConfig.h"
+#include "EventLog.h"
+#include "WarmStart.h"
 
 // Minimum time between two limit-switch triggers on the same axis (ms).
 // Filters electrical noise spikes without delaying real events.
 #define LIMIT_DEBOUNCE_MS 5
 
-struct MotorSettings {
-    float    maxSpeed;
-    float    acceleration;
-    uint16_t stepsPerUnit;
-    bool     invertDirection;
-    bool     enable;
-};
+// Period of the commanded-vs-encoder comparison in runAll() (ms).
+#define ENCODER_CHECK_MS 10
+
+// Host-facing positions are fixed-point milli-units ("mu", 1/1000 unit), so
+// `move y 1.5` is exact and the unit <-> step conversion stays integer.
+#define MU_PER_UNIT 1000L
+
+// Input shaper: reference-position samples kept per axis. The longest
+// impulse delay spans the whole buffer, so more samples interpolate finer.
+#define SHAPER_SAMPLES   25
+#define SHAPER_MAX_HZ    100.0f
+
+// Streaming setpoint (tracking) mode.
+#define TRACK_UPDATE_MS  5      // speed recomputation period (ms)
+#define TRACK_GAIN       8.0f   // position loop gain (1/s)
+#define TRACK_TIMEOUT_MS 200    // setpoint age after which extrapolation stops (ms)
 
 struct LimitSwitches {
     uint8_t minPin;
     uint8_t maxPin;
 
+    // Input register + bit mask of each pin, cached so the ISR can snapshot
+    // the port directly instead of going through digitalRead(). A null
+    // register means that end has no switch (NO_PIN) or is not attached yet.
+    volatile uint8_t *minReg;
+    volatile uint8_t *maxReg;
+    uint8_t           minMask;
+    uint8_t           maxMask;
+
     // Written by ISR → must be volatile so the compiler never caches them.
-    volatile bool     limitHit;
+    volatile bool     limitHit;        // latched until the retract completes
     volatile bool     isRetracting;
     volatile bool     minTriggered;
     volatile bool     maxTriggered;
-    // Set in ISR, cleared in runAll() after the message is printed safely.
-    volatile bool     needsPrint;
-    volatile uint32_t lastTriggerMs;   // debounce timestamp
+    volatile bool     isMinHit;        // which end triggered
+    // Set in ISR, cleared in runAll() once the retract is queued and printed.
+    volatile bool     needsService;
+    volatile uint32_t triggerUs;       // micros() at trigger, also used for debounce
+};
+
+// Worst-case and last measured stop behaviour of one axis after a limit trip.
+// "Steps" are STEP pulses that still went out after the ISR ran, "us" is the
+// time from the ISR to the last of those pulses (0 when none went out).
+struct LimitLatency {
+    uint16_t trips;
+    uint8_t  lastSteps;
+    uint8_t  worstSteps;
+    uint32_t lastUs;
+    uint32_t worstUs;
+};
+
+// Soft travel limits, learned from where each switch last triggered (steps,
+// same reference as currentPosition()). Targets are clamped softMargin
+// inside them, so AccelStepper plans its deceleration to stop short of the
+// switch instead of tripping it.
+struct SoftLimits {
+    bool   minKnown;
+    bool   maxKnown;
+    long   minSwitchSteps;
+    long   maxSwitchSteps;
+    int8_t clamped;         // -1 / +1: the current move was cut at the min / max soft limit
+};
+
+// Quadrature decoder state of one axis (see EncoderConfig).
+struct EncoderState {
+    volatile uint8_t *regA;       // null when the axis has no encoder
+    volatile uint8_t *regB;
+    uint8_t           maskA;
+    uint8_t           maskB;
+
+    // Written by ISR.
+    volatile uint8_t  lastAB;     // previous A/B level pair, 2 bits
+    volatile long     count;
+
+    // Main-loop only.
+    float             stepsPerCount;
+    long              errorSteps; // commanded - measured at the last check
+};
+
+// Follower state of one axis in tracking mode. The host streams absolute
+// setpoints; between them the target is extrapolated at the setpoint velocity
+// and the axis runs in constant-speed mode, so it never stops in between.
+struct TrackState {
+    bool     active;
+    bool     stopping;      // ramping down to zero speed, then leave tracking
+    long     targetSteps;   // last setpoint
+    float    velocity;      // steps/s between the last two setpoints
+    uint32_t setpointMs;    // arrival time of the last setpoint
+    uint32_t lastUpdateMs;
+    float    speed;         // currently commanded speed, steps/s
+    long     errorSteps;    // following error at the last update
+};
+
+// Latency trace of one `run ... t=<id>` command: when its line started
+// arriving, when it was dispatched and when the first STEP edge went out.
+struct StepTrace {
+    uint16_t id;
+    bool     pending;       // armed, waiting for the first STEP edge
+    uint32_t rxUs;
+    uint32_t dispatchUs;
+    uint32_t stepUs;
+};
+
+// Microstep resolution of one axis (see MicrostepConfig). While coarse,
+// AccelStepper counts coarse steps; everything outside StepperMotors keeps
+// seeing fine steps.
+struct MicrostepState {
+    uint8_t fineLog;        // log2(fine microsteps), for MICROSTEP_PATTERNS
+    uint8_t coarseShift;    // log2(fine / coarse); 0 = no switching
+    uint8_t shift;          // current: 0 = fine, coarseShift = coarse
+    bool    autoCoarse;     // `axe X microstep=auto|fine`
+    float   coarseSpeed;    // fine steps/s
+    bool    finishFine;     // after the coarse leg, a fine leg to fineTarget
+    long    fineTarget;
+    long    gridBase;       // a position on the driver's coarse grid (fine steps);
+                            // follows re-origins, which do not move the driver
+};
 
-    // Read only in main-loop context (safe without volatile).
-    bool isMinHit;   // which end triggered (for the print message)
+// AccelStepper whose STEP output can be gated from interrupt context.
+// While `halted` is set no pulse is emitted; AccelStepper still advances its
+// internal position, so the suppressed steps are counted and undone later.
+//
+// With an input shaper (ZV or ZVD) AccelStepper's position becomes the
+// reference profile only. runShaper() convolves it with two or three
+// impulses tuned to the stage resonance and pulses the motor toward the
+// result, so the move ends without exciting the ringing. The motor lags
+// the reference by up to one (ZV) or two (ZVD) half damped periods.
+class GatedStepper : public AccelStepper {
+public:
+    GatedStepper(uint8_t stepPin, uint8_t dirPin);
+
+    volatile bool     halted;           // set by limit ISR, cleared in runAll()
+    volatile uint8_t  stepsAfterHalt;   // pulses in flight when the ISR ran
+    uint32_t          lastStepUs;       // only stamped for in-flight pulses
+    long              suppressedSteps;  // net steps swallowed while halted
+    bool              traceArmed;       // stamp the next pulse into firstStepUs
+    uint32_t          firstStepUs;
+    long              gridOffset;       // fine steps off the coarse grid, until the next pulse
+    volatile uint16_t pulses;           // fine steps pulsed, wrapping; read by the strobe ISR
+    uint8_t           pulseShift;       // log2(fine steps per pulse), follows the resolution
+
+    void  setShaper(float hz, float damping, bool zvd);  // hz 0 = off; axis at rest
+    void  runShaper();                  // after run(): at most one pulse
+    bool  isShaped() const { return shaperHz > 0.0f; }
+    bool  shaperBusy();                 // motor still catching up with the reference
+    float getShaperHz() const { return shaperHz; }
+    float getShaperDamping() const { return shaperDamping; }
+    bool  isShaperZvd() const { return shaperImpulses == 3; }
+
+    // Where the pulses have taken the motor; AccelStepper's own position
+    // when not shaped.
+    long outputPosition() { return isShaped() ? output : currentPosition(); }
+    void setCurrentPosition(long position);  // re-origin; the lag is kept
+    void resync(long position);              // the motor is at `position`: no lag
+
+protected:
+    virtual void step(long step);
+
+private:
+    float    shaperHz;
+    float    shaperDamping;
+    uint8_t  shaperImpulses;            // 2 = ZV, 3 = ZVD
+    float    amplitude[3];
+    uint8_t  span;                      // samples between impulses
+    uint32_t tickUs;                    // sample period
+    float    perTickUs;                 // 1 / tickUs
+    uint32_t sampleUs;                  // time of the newest sample
+    uint8_t  newest;                    // index into history
+    uint8_t  quiet;                     // consecutive samples equal to the newest
+    long     output;
+    long     history[SHAPER_SAMPLES];
+
+    void pulse(long step);
+    long sample(uint8_t age) const { return history[(newest + SHAPER_SAMPLES - age) % SHAPER_SAMPLES]; }
 };
 
 class StepperMotors {
 public:
-    enum Axis { X = 0, Y = 1, Z = 2 };
+    // Index into AXES_CONFIG.
+    typedef uint8_t Axis;
+
+    // Axis whose CLI name matches `name` (case-insensitive), or -1.
+    static int axisFromName(const char *name);
+    static char axisName(Axis axis) { return AXES_CONFIG[axis].name; }
+    static String axisList();   // e.g. "X|Y|Z", for usage messages
+    static long parseMu(const char *text);  // "-1.5" -> -1500, no float math
+    static String formatMu(long mu);        // -1500 -> "-1.500"
 
     StepperMotors();
     virtual ~StepperMotors();
@@ -51,36 +213,110 @@ public:
 
     static void axisCallback(int arg_cnt, char **args);
 
-    void moveTo(Axis axis, long units);
-    void moveRelative(Axis axis, long units);
-    void setCurrentPosition(Axis axis, long units);
+    // Positions in mu. Targets round to the nearest step; consecutive
+    // relative moves build on the exact commanded target, so the rounding
+    // error never accumulates.
+    void moveTo(Axis axis, long mu);
+    void moveRelative(Axis axis, long mu);
+    void setCurrentPosition(Axis axis, long mu);
+    long muToSteps(Axis axis, long mu) const;
+    long stepsToMu(Axis axis, long steps) const;
     void stop(Axis axis);
     void runAll();
     bool isRunning(Axis axis) const;
+    bool isAnyRunning() const;
+    long  getPosition(Axis axis) const;       // fine steps
+    float getSpeed(Axis axis) const;          // fine steps/s
+    long  getDistanceToGo(Axis axis) const;   // fine steps, including a pending fine leg
+    uint8_t getMicrosteps(Axis axis) const;   // current resolution, 0 = not switchable
+    bool  isEnabled(Axis axis) const { return motors[axis].enable; }
+    bool  isHalted(Axis axis) const { return steppers[axis]->halted; }  // limit ISR, until serviced
+
+    // Steps pulsed outside AccelStepper (see StepBlocks): the motor moved,
+    // so unlike setCurrentPosition() the switch positions stay put.
+    void  addSteps(Axis axis, long steps);
+    bool  insideSoftLimits(Axis axis, long steps) const { return clampToSoftLimits(axis, steps) == steps; }
+
+    // Fine steps actually pulsed by AccelStepper, wrapping at 16 bits. Safe
+    // to read from an ISR, unlike the position (see Strobe).
+    uint16_t getPulseCount(Axis axis) const { return steppers[axis]->pulses; }
+
+    void trackTo(Axis axis, long mu);       // new streaming setpoint (absolute)
+    void endTracking(Axis axis);            // decelerate, then leave tracking
+    bool isTracking(Axis axis) const { return tracks[axis].active; }
+    long getFollowingError(Axis axis) const { return tracks[axis].errorSteps; }
+
+    // Stamps the first STEP edge of `axis` (-1: any axis) and reports it as
+    // ^TRACE; the times come from Cmd::RxMicros()/DispatchMicros().
+    void traceFirstStep(int axis, uint16_t id, uint32_t rxUs, uint32_t dispatchUs);
+    const StepTrace &getTrace() const { return trace; }
 
     void attachLimitSwitches(Axis axis, uint8_t minPin, uint8_t maxPin);
     bool isLimitReached(Axis axis, bool minLimit) const;
     bool limitTriggered() const;          // true if ANY axis pin is LOW
     bool limitTriggered(Axis axis) const; // true if this axis pin is LOW
     bool isRetracting(Axis axis) const;
+    LimitLatency getLimitLatency(Axis axis) const;
+    void forgetSoftLimits(Axis axis);     // until the switches trip again
+
+    // Position retention across resets (see WarmStart). After a power cycle
+    // (driverReset) the driver restarts from its home microstep.
+    void snapshot(Axis axis, AxisSnapshot &snap) const;
+    void restore(Axis axis, const AxisSnapshot &snap, bool driverReset);
+
+    bool hasEncoder(Axis axis) const { return encoders[axis].regA != nullptr; }
+    long getEncoderCount(Axis axis) const;
+    long getPositionError(Axis axis) const { return encoders[axis].errorSteps; }
+
+    static void limitsCallback(int arg_cnt, char **args);
+
+    // Single ISR shared by every limit pin (external or pin-change): snapshots
+    // all switch inputs and halts the STEP output of the axis that tripped.
+    static void handleLimitInterrupt();
+    static void handleEncoderInterrupt();
+    static void handlePinChange();      // shared body of the PCINTn vectors
+
+    // Emergency stop from the serial receive ISR (see MegaBoard): gates every
+    // STEP output and cuts the drivers. serviceEmergencyStop() then settles
+    // the positions in the main loop and returns how long that took (us).
+    static void handleEmergencyStop();
+    bool emergencyStopPending() const { return estopPending; }
+    uint32_t serviceEmergencyStop();
 
 private:
-    MotorSettings motors[3];
-    AccelStepper *steppers[3];
-    LimitSwitches limitSwitches[3];
-    uint8_t enablePins[3];
+    MotorSettings motors[AXIS_COUNT];
+    GatedStepper *steppers[AXIS_COUNT];
+    LimitSwitches limitSwitches[AXIS_COUNT];
+    LimitLatency  limitLatency[AXIS_COUNT];
+    SoftLimits    softLimits[AXIS_COUNT];
+    long          targetMu[AXIS_COUNT];     // last commanded target, exact
+    EncoderState  encoders[AXIS_COUNT];
+    TrackState    tracks[AXIS_COUNT];
+    MicrostepState microsteps[AXIS_COUNT];
+    StepTrace     trace;
+    uint32_t      lastEncoderCheckMs;
+    volatile bool estopPending;         // set by the e-stop ISR, cleared once serviced
+    volatile uint32_t estopUs;          // micros() at the trip
 
-    void initializeStepper(Axis axis, uint8_t stepPin, uint8_t dirPin);
+    static bool limitsOnPinChange;      // any limit switch routed through PCINT
+    static bool encodersOnPinChange;
 
-    static void handleInterruptXMin();
-    static void handleInterruptXMax();
-    static void handleInterruptYMin();
-    static void handleInterruptYMax();
-    static void handleInterruptZMin();
-    static void handleInterruptZMax();
+    void initializeStepper(Axis axis, uint8_t stepPin, uint8_t dirPin);
+    static void attachLimitPin(uint8_t pin);
+    void attachEncoder(Axis axis, const EncoderConfig &cfg);
+    static void attachEncoderPin(uint8_t pin);
+    void attachMicrostep(Axis axis, const MicrostepConfig &cfg);
+    void setResolution(Axis axis, uint8_t shift, long direction = 1);
+    void applySpeedLimits(Axis axis);
+    void startMove(Axis axis, long targetSteps);
+    void checkEncoders();
+    void syncEncoder(Axis axis, long steps);
+    void updateTracking(Axis axis, uint32_t now);
+    void reportTrace();
+    long clampToSoftLimits(Axis axis, long targetSteps, int8_t *side = nullptr) const;
 
     static String toJson(Axis axis);
-    void onLimitHit(Axis axis, bool isMin);
+    void serviceLimitHit(Axis axis);
 
     static StepperMotors *instance;
 };
@@ -0,0 +1,182 @@
+/**
+ * ===============================================================
+ *  Strobe.cpp
+ *  XYZ Camera Positioning System - Position-latched Camera Strobe
+ * ===============================================================
+ */
+
+#include "Strobe.h"
+#include "StepperMotors.h"
+#include "StepBlocks.h"
+#include "MegaBoard.h"
+
+#define STROBE_TICK_US (64000000UL / F_CPU)    // Timer4 at clk/64
+
+StepperMotors    *Strobe::aMotors   = nullptr;
+bool              Strobe::aEnabled  = false;
+bool              Strobe::aRising   = true;
+StrobeSample      Strobe::aSamples[STROBE_SLOTS];
+volatile uint8_t  Strobe::aHead     = 0;
+uint8_t           Strobe::aResolved = 0;
+uint8_t           Strobe::aSent     = 0;
+volatile uint16_t Strobe::aSeq      = 0;
+volatile uint16_t Strobe::aDropped  = 0;
+uint32_t          Strobe::aOldestMs = 0;
+
+// ICR4 holds the count at the edge; the count since then dates it back
+// from the ISR's own micros().
+ISR(TIMER4_CAPT_vect)
+{
+	uint16_t edge    = ICR4;
+	uint16_t elapsed = TCNT4 - edge;
+	Strobe::Capture(micros() - (uint32_t)elapsed * STROBE_TICK_US);
+}
+
+void Strobe::Begin(StepperMotors *motors)
+{
+	aMotors = motors;
+	pinMode(STROBE_PIN, INPUT);
+	Off();
+}
+
+// Timer4 runs free over all 16 bits (normal mode, instead of the core's
+// 8-bit PWM setup); pins 6-8 are never used for PWM here.
+void Strobe::On(bool rising)
+{
+	noInterrupts();
+	aHead    = aResolved = aSent = 0;
+	aSeq     = 0;
+	aDropped = 0;
+	aRising  = rising;
+	TCCR4A   = 0;
+	TCCR4B   = _BV(ICNC4) | (rising ? _BV(ICES4) : 0) | _BV(CS41) | _BV(CS40);
+	TIFR4    = _BV(ICF4);
+	TIMSK4   = _BV(ICIE4);
+	aEnabled = true;
+	interrupts();
+}
+
+// Samples already captured are still sent.
+void Strobe::Off()
+{
+	TIMSK4   = 0;
+	TCCR4B   = 0;
+	aEnabled = false;
+}
+
+// Only ever changed with interrupts off or from ISRs, which do not nest.
+uint16_t Strobe::pulseCount(uint8_t axis)
+{
+	return aMotors->getPulseCount(axis) + StepBlocks::PulseCount(axis);
+}
+
+void Strobe::Capture(uint32_t us)
+{
+	uint16_t seq = aSeq++;
+	if ((uint8_t)(aHead - aSent) >= STROBE_SLOTS) {
+		aDropped++;
+		return;
+	}
+	StrobeSample &s = aSamples[aHead % STROBE_SLOTS];
+	s.seq = seq;
+	s.us  = us;
+	for (uint8_t i = 0; i < AXIS_COUNT; i++)
+		s.pulses[i] = pulseCount(i);
+	aHead++;
+}
+
+// A sample's position is the position now, less the pulses since its
+// edge. Nothing pulses between here and runAll() but the block ISR, whose
+// steps not yet folded in are counted with the pulse counts.
+void Strobe::Loop()
+{
+	if (aResolved != aHead) {
+		uint16_t now[AXIS_COUNT];
+		long     base[AXIS_COUNT];
+		noInterrupts();
+		uint8_t head = aHead;
+		for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+			now[i]  = pulseCount(i);
+			base[i] = StepBlocks::Unfolded(i);
+		}
+		interrupts();
+
+		for (uint8_t i = 0; i < AXIS_COUNT; i++)
+			base[i] += aMotors->getPosition(i);
+		if (aResolved == aSent)
+			aOldestMs = millis();
+		for (; aResolved != head; aResolved++) {
+			StrobeSample &s = aSamples[aResolved % STROBE_SLOTS];
+			for (uint8_t i = 0; i < AXIS_COUNT; i++)
+				s.steps[i] = base[i] - (int16_t)(now[i] - s.pulses[i]);
+		}
+	}
+
+	uint8_t ready = aResolved - aSent;
+	if (ready >= STROBE_BATCH || (ready && millis() - aOldestMs >= STROBE_FLUSH_MS)) {
+		send(min(ready, (uint8_t)STROBE_BATCH));
+		aOldestMs = millis();
+	}
+}
+
+// ^STROBE [seq=<first> n=<count> dropped=<total>], then one line per
+// sample: <seq> <us> <steps per axis...>
+void Strobe::send(uint8_t count)
+{
+	MegaBoard::Print(F("^STROBE [seq="));
+	MegaBoard::Print(aSamples[aSent % STROBE_SLOTS].seq);
+	MegaBoard::Print(F(" n="));
+	MegaBoard::Print(count);
+	MegaBoard::Print(F(" dropped="));
+	MegaBoard::Print(aDropped);
+	MegaBoard::Print(']');
+	for (uint8_t n = 0; n < count; n++, aSent++) {
+		const StrobeSample &s = aSamples[aSent % STROBE_SLOTS];
+		MegaBoard::Println();
+		MegaBoard::Print(s.seq);
+		MegaBoard::Print(' ');
+		MegaBoard::Print(s.us);
+		for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+			MegaBoard::Print(' ');
+			MegaBoard::Print(s.steps[i]);
+		}
+	}
+	MegaBoard::Println("");
+}
+
+void Strobe::status()
+{
+	MegaBoard::Print(F("{\"on\":"));
+	MegaBoard::Print(aEnabled ? F("true") : F("false"));
+	MegaBoard::Print(F(",\"edge\":\""));
+	MegaBoard::Print(aRising ? F("rising") : F("falling"));
+	MegaBoard::Print(F("\",\"captured\":"));
+	MegaBoard::Print(aSeq - aDropped);
+	MegaBoard::Print(F(",\"dropped\":"));
+	MegaBoard::Print(aDropped);
+	MegaBoard::Print(F(",\"pending\":"));
+	MegaBoard::Print((uint8_t)(aHead - aSent));
+	MegaBoard::Print(F(",\"pin\":"));
+	MegaBoard::Print(STROBE_PIN);
+	MegaBoard::Println('}');
+}
+
+// Usage: strobe on [rising|falling]   latch the positions on each strobe edge (default rising)
+//        strobe off
+//        strobe                       capture state (JSON)
+void Strobe::StrobeCallback(int arg_cnt, char **args)
+{
+	if (arg_cnt < 2) {
+		status();
+	} else if (!strcmp(args[1], "on") && (arg_cnt < 3 || !strcmp(args[2], "rising") || !strcmp(args[2], "falling"))) {
+		bool rising = arg_cnt < 3 || !strcmp(args[2], "rising");
+		On(rising);
+		MegaBoard::Println(rising ? F("[Strobe] On, rising edge") : F("[Strobe] On, falling edge"));
+	} else if (!strcmp(args[1], "off")) {
+		Off();
+		MegaBoard::Println("[Strobe] Off, " + String(aSeq - aDropped) + " captured, " + String(aDropped) + " dropped");
+	} else {
+		Cmd::Refuse();
+		MegaBoard::Println(F("[Strobe] Usage: strobe [on [rising|falling]|off]"));
+	}
+}
@@ -0,0 +1,76 @@
+/**
+ * ===============================================================
+ *  Strobe.h
+ *  XYZ Camera Positioning System - Position-latched Camera Strobe
+ * ===============================================================
+ *  Description:
+ *  - Timer4 input capture on ICP4 (pin 49) timestamps every strobe
+ *    edge from the camera in hardware, to 4 us, with the noise
+ *    canceller on. The external interrupt pins all go to the limit
+ *    switches; the capture unit needs none of them.
+ *  - The ISR latches each axis' pulse count with the timestamp; the
+ *    main loop turns those into positions, so no 32-bit position is
+ *    ever read half-updated. Positions include step blocks.
+ *  - Samples wait in a ring buffer and are streamed in batches as
+ *    ^STROBE events; a full buffer drops the frame and counts it.
+ * ===============================================================
+ */
+
+#ifndef STROBE_H_
+#define STROBE_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "AxesConfig.h"
+
+#define STROBE_PIN      49      // ICP4
+#define STROBE_SLOTS    16      // samples, power of two
+#define STROBE_BATCH    8       // samples per ^STROBE event
+#define STROBE_FLUSH_MS 100     // longest a sample waits for its batch
+
+struct StrobeSample {
+	uint16_t seq;               // counts every edge, so dropped frames leave a gap
+	uint32_t us;                // micros() at the edge
+	uint16_t pulses[AXIS_COUNT];// pulse counts at the edge (ISR)
+	long     steps[AXIS_COUNT]; // fine steps, once resolved
+};
+
+class StepperMotors;
+
+class Strobe {
+public:
+	static void Begin(StepperMotors *motors);
+	static void On(bool rising);
+	static void Off();
+	static bool Enabled() { return aEnabled; }
+
+	// Resolves new samples and sends a batch when one is due; runs
+	// before StepperMotors::runAll(), after StepBlocks::Loop().
+	static void Loop();
+
+	static void Capture(uint32_t us);      // Timer4 capture ISR body
+
+	static void StrobeCallback(int arg_cnt, char **args);
+
+private:
+	static StepperMotors *aMotors;
+	static bool     aEnabled;
+	static bool     aRising;
+	static StrobeSample aSamples[STROBE_SLOTS];
+	static volatile uint8_t  aHead;         // next free slot (ISR)
+	static uint8_t  aResolved;              // next sample to resolve
+	static uint8_t  aSent;                  // next sample to send
+	static volatile uint16_t aSeq;
+	static volatile uint16_t aDropped;
+	static uint32_t aOldestMs;              // when the oldest unsent sample was resolved
+
+	static uint16_t pulseCount(uint8_t axis);
+	static void send(uint8_t count);
+	static void status();
+};
+
+#endif /* STROBE_H_ */
@@ -0,0 +1,187 @@
+/**
+ * ===============================================================
+ *  WarmStart.cpp
+ *  XYZ Camera Positioning System - Position Retention Across Resets
+ * ===============================================================
+ */
+
+#include "WarmStart.h"
+#include "StepperMotors.h"
+#include "StepBlocks.h"
+#include "BoardShim.h"
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#define WARM_MAGIC   0x3A7E
+#define SLOT_AT_REST 0x00   // state byte after each slot
+#define SLOT_MOVING  0x4D   // the stage moved since this checkpoint
+#define SLOT_NONE    0xFF   // no valid slot yet (erased EEPROM)
+
+WarmStart::Record WarmStart::aRam[2] __attribute__((section(".noinit")));
+WarmStart::Record WarmStart::aRestored;
+WarmStart::Record WarmStart::aSaved;
+WarmSource        WarmStart::aSource      = WarmSource::NONE;
+uint8_t           WarmStart::aRamIndex    = 0;
+uint8_t           WarmStart::aSlot        = 0;
+uint8_t           WarmStart::aSlotState   = SLOT_NONE;
+int16_t           WarmStart::aWriteIndex  = -1;
+uint32_t          WarmStart::aCheckpointMs = 0;
+uint32_t          WarmStart::aLastMoveMs  = 0;
+
+// Runs before the C runtime initialization. A watchdog reset leaves the
+// watchdog enabled at its shortest period, which would fire again long
+// before setup() is done, so it is turned off here; MCUSR must be cleared
+// first, and is kept for Begin().
+static uint8_t resetFlags __attribute__((section(".noinit")));
+
+BOARD_EARLY_INIT(warmEarlyInit)
+{
+	resetFlags = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+}
+
+uint16_t WarmStart::crc(const Record &r)
+{
+	const uint8_t *p = (const uint8_t *)&r;
+	uint16_t c = 0xFFFF;
+	for (uint16_t i = 0; i < offsetof(Record, crc); i++)
+		c = _crc16_update(c, p[i]);
+	return c;
+}
+
+uint8_t *WarmStart::slotAddress(uint8_t slot)
+{
+	static_assert(WARM_EEPROM_BASE + WARM_EEPROM_SLOTS * (sizeof(Record) + 1) <= E2END + 1,
+	              "EEPROM slot ring does not fit");
+	return (uint8_t *)(WARM_EEPROM_BASE + slot * (sizeof(Record) + 1));
+}
+
+// Newest valid slot (wrap-safe sequence compare) into aSaved.
+void WarmStart::loadNewestSlot()
+{
+	Record r;
+	memset(&aSaved, 0, sizeof(aSaved));
+	aSlot      = WARM_EEPROM_SLOTS - 1;  // first checkpoint goes to slot 0
+	aSlotState = SLOT_NONE;
+
+	for (uint8_t s = 0; s < WARM_EEPROM_SLOTS; s++) {
+		eeprom_read_block(&r, slotAddress(s), sizeof(r));
+		if (r.magic != WARM_MAGIC || !valid(r))
+			continue;
+		if (aSlotState != SLOT_NONE && (int16_t)(r.seq - aSaved.seq) <= 0)
+			continue;
+		aSaved     = r;
+		aSlot      = s;
+		aSlotState = (eeprom_read_byte(slotAddress(s) + sizeof(r)) == SLOT_AT_REST) ?
+		             SLOT_AT_REST : SLOT_MOVING;
+	}
+}
+
+uint8_t WarmStart::Begin()
+{
+	BoardKeepNoinit(aRam, sizeof(aRam));
+	loadNewestSlot();
+
+	// After a power-on or brown-out the .noinit RAM is random. Otherwise
+	// take the newer of the two buffers; a reset while one was being
+	// rewritten leaves the other intact.
+	aSource = WarmSource::NONE;
+	if (!(resetFlags & (_BV(PORF) | _BV(BORF)))) {
+		for (uint8_t i = 0; i < 2; i++) {
+			const Record &r = aRam[i];
+			if (r.magic != WARM_MAGIC || !valid(r))
+				continue;
+			if (aSource == WarmSource::RAM && (int16_t)(r.seq - aRestored.seq) <= 0)
+				continue;
+			aRestored = r;
+			aRamIndex = i;
+			aSource   = WarmSource::RAM;
+		}
+	}
+
+	// A checkpoint the stage moved away from says nothing about where it is.
+	if (aSource == WarmSource::NONE && aSlotState == SLOT_AT_REST) {
+		aRestored = aSaved;
+		aSource   = WarmSource::EEPROM;
+	}
+	return resetFlags;
+}
+
+void WarmStart::Loop(StepperMotors &motors)
+{
+	uint32_t now    = millis();
+	bool     moving = motors.isAnyRunning() || StepBlocks::Playing();
+
+	if (now - aCheckpointMs >= WARM_CHECKPOINT_MS) {
+		aCheckpointMs = now;
+		Record &r = aRam[aRamIndex ^ 1];
+		r.magic = WARM_MAGIC;
+		r.seq   = aRam[aRamIndex].seq + 1;
+		for (uint8_t i = 0; i < AXIS_COUNT; i++)
+			motors.snapshot(i, r.axes[i]);
+		r.crc     = crc(r);
+		aRamIndex ^= 1;
+	}
+
+	serviceEeprom(moving, now);
+}
+
+// At most one byte per pass and only when the EEPROM is ready: a byte takes
+// 3.3 ms to program, which must not stall the step generation. Slot bytes
+// go first and the state byte last, so a torn write fails the CRC or reads
+// as "moved" and the previous slot stays in charge.
+void WarmStart::serviceEeprom(bool moving, uint32_t now)
+{
+	if (moving)
+		aLastMoveMs = now;
+	if (!eeprom_is_ready())
+		return;
+
+	if (aWriteIndex >= 0) {
+		uint8_t *slot = slotAddress(aSlot);
+		if (moving)
+			aSlotState = SLOT_MOVING;   // finish the slot, but as already outdated
+		if (aWriteIndex < (int16_t)sizeof(Record)) {
+			eeprom_update_byte(slot + aWriteIndex, ((const uint8_t *)&aSaved)[aWriteIndex]);
+			aWriteIndex++;
+		} else {
+			if (aSlotState != SLOT_MOVING)
+				aSlotState = SLOT_AT_REST;
+			eeprom_update_byte(slot + sizeof(Record), aSlotState);
+			aWriteIndex = -1;
+		}
+		return;
+	}
+
+	if (moving) {
+		if (aSlotState == SLOT_AT_REST) {
+			eeprom_update_byte(slotAddress(aSlot) + sizeof(Record), SLOT_MOVING);
+			aSlotState = SLOT_MOVING;
+		}
+		return;
+	}
+
+	if (now - aLastMoveMs < WARM_SAVE_IDLE_MS)
+		return;
+
+	const Record &cur = aRam[aRamIndex];
+	if (aSlotState != SLOT_NONE && !memcmp(cur.axes, aSaved.axes, sizeof(cur.axes))) {
+		// Back where the last checkpoint was taken: just mark it valid again.
+		if (aSlotState == SLOT_MOVING) {
+			eeprom_update_byte(slotAddress(aSlot) + sizeof(Record), SLOT_AT_REST);
+			aSlotState = SLOT_AT_REST;
+		}
+		return;
+	}
+
+	memcpy(aSaved.axes, cur.axes, sizeof(cur.axes));
+	aSaved.magic = WARM_MAGIC;
+	aSaved.seq++;
+	aSaved.crc   = crc(aSaved);
+	aSlot        = (aSlot + 1) % WARM_EEPROM_SLOTS;
+	aSlotState   = SLOT_NONE;
+	aWriteIndex  = 0;
+}
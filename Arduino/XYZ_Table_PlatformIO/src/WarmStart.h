@@ -0,0 +1,93 @@
+/**
+ * ===============================================================
+ *  WarmStart.h
+ *  XYZ Camera Positioning System - Position Retention Across Resets
+ * ===============================================================
+ *  Description:
+ *  - Keeps a CRC-checked snapshot of every axis (position, last target,
+ *    learned switch positions) in .noinit RAM, refreshed from the main
+ *    loop, so a watchdog, reset-button or host (DTR) reset restores the
+ *    positions and boots without the fixed start-up delay.
+ *  - Checkpoints the snapshot to EEPROM once the stage has been idle for
+ *    a while, rotating over a ring of slots to spread the wear, so a
+ *    power cycle can restore the last position the stage stood still at.
+ *  - Supervises the main loop with the watchdog.
+ * ===============================================================
+ */
+
+#ifndef WARMSTART_H_
+#define WARMSTART_H_
+
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include <avr/wdt.h>
+#include "AxesConfig.h"
+
+#define WARM_WATCHDOG      WDTO_1S  // main loop iterations longer than this reset the board
+#define WARM_CHECKPOINT_MS 10       // .noinit snapshot refresh period
+#define WARM_SAVE_IDLE_MS  2000     // standstill before the EEPROM checkpoint
+#define WARM_EEPROM_BASE   0        // first byte of the slot ring
+#define WARM_EEPROM_SLOTS  32
+
+// AxisSnapshot::flags
+#define WARM_MIN_KNOWN 0x01
+#define WARM_MAX_KNOWN 0x02
+#define WARM_MOVING    0x04         // the axis was running when the snapshot was taken
+
+// Fixed-width fields: the same bytes go to EEPROM.
+struct AxisSnapshot {
+	int32_t steps;          // fine steps
+	int32_t targetMu;
+	int32_t gridBase;       // see MicrostepState
+	int32_t minSwitchSteps;
+	int32_t maxSwitchSteps;
+	uint8_t flags;
+};
+
+enum class WarmSource : uint8_t {
+	NONE = 0,
+	RAM,            // .noinit snapshot after a non-power-on reset
+	EEPROM          // last idle checkpoint after a power cycle
+};
+
+class StepperMotors;
+
+class WarmStart {
+public:
+	static uint8_t Begin();                 // validates the snapshots, returns the reset flags
+	static WarmSource Source() { return aSource; }
+	static const AxisSnapshot &Restored(uint8_t axis) { return aRestored.axes[axis]; }
+	static void EnableWatchdog() { wdt_enable(WARM_WATCHDOG); }
+	static void Loop(StepperMotors &motors);
+
+private:
+	struct Record {
+		uint16_t     magic;
+		uint16_t     seq;       // EEPROM slot order
+		AxisSnapshot axes[AXIS_COUNT];
+		uint16_t     crc;       // over everything above
+	};
+
+	static Record     aRam[2];      // .noinit, written alternately
+	static Record     aRestored;
+	static Record     aSaved;       // newest EEPROM slot, or the one being written
+	static WarmSource aSource;
+	static uint8_t    aRamIndex;    // newer of aRam[]
+	static uint8_t    aSlot;        // index of aSaved
+	static uint8_t    aSlotState;   // state byte of aSlot
+	static int16_t    aWriteIndex;  // next byte of aSaved to write, -1 when idle
+	static uint32_t   aCheckpointMs;
+	static uint32_t   aLastMoveMs;
+
+	static uint16_t crc(const Record &r);
+	static bool valid(const Record &r) { return crc(r) == r.crc; }
+	static uint8_t *slotAddress(uint8_t slot);
+	static void loadNewestSlot();
+	static void serviceEeprom(bool moving, uint32_t now);
+};
+
+#endif /* WARMSTART_H_ */
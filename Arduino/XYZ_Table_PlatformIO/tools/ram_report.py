@@ -0,0 +1,74 @@
+"""Static RAM per module (.data + .bss/.noinit), read from the object files.
+
+PlatformIO runs this after linking (platformio.ini: extra_scripts =
+post:tools/ram_report.py) and prints one row per object file, firmware
+sources first, then the Arduino core and libraries. Standalone:
+
+    python tools/ram_report.py .pio/build/mega [--nm avr-nm]
+"""
+
+import argparse
+import subprocess
+from pathlib import Path
+
+DATA_TYPES = "dDgG"   # initialised data: costs RAM and flash
+BSS_TYPES  = "bBsSC"  # zero-filled / .noinit / common
+
+
+def object_usage(nm, obj):
+    """(data, bss) bytes defined by one object file."""
+    out = subprocess.run([nm, "-S", str(obj)], capture_output=True, text=True).stdout
+    data = bss = 0
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) < 4:
+            continue                  # undefined symbol, no size
+        size, kind = int(parts[1], 16), parts[2]
+        if kind in DATA_TYPES:
+            data += size
+        elif kind in BSS_TYPES:
+            bss += size
+    return data, bss
+
+
+def report(build_dir, nm="avr-nm", ram_size=8192):
+    build_dir = Path(build_dir)
+    rows = []
+    for obj in sorted(build_dir.rglob("*.o")):
+        data, bss = object_usage(nm, obj)
+        if data or bss:
+            group = "src" if "src" in obj.relative_to(build_dir).parts[:1] else "lib"
+            rows.append((group, obj.name[:-2], data, bss))
+
+    rows.sort(key=lambda r: (r[0] != "src", -(r[2] + r[3])))
+    total_data = sum(r[2] for r in rows)
+    total_bss  = sum(r[3] for r in rows)
+
+    print("\nStatic RAM per module (bytes)")
+    print(f"  {'module':<28} {'data':>6} {'bss':>6} {'total':>6}")
+    for group, name, data, bss in rows:
+        print(f"  {group + '/' + name:<28} {data:>6} {bss:>6} {data + bss:>6}")
+    total = total_data + total_bss
+    print(f"  {'TOTAL':<28} {total_data:>6} {total_bss:>6} {total:>6}"
+          f"   ({100.0 * total / ram_size:.1f}% of {ram_size}; heap + stack get the rest)")
+
+
+try:
+    Import("env")   # noqa: F821 -- defined when PlatformIO runs this script
+except NameError:
+    env = None
+
+if env is not None:
+    def _after_link(source, target, env):
+        report(env.subst("$BUILD_DIR"), env.subst("$NM") or "avr-nm",
+               int(env.BoardConfig().get("upload.maximum_ram_size", 8192)))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", _after_link)
+
+elif __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("build_dir")
+    parser.add_argument("--nm", default="avr-nm")
+    parser.add_argument("--ram", type=int, default=8192, help="SRAM size (Mega 2560: 8192)")
+    args = parser.parse_args()
+    report(args.build_dir, args.nm, args.ram)
@@ -1,11 +1,12 @@
+import argparse
 import asyncio
 import sys
 import re
 import logging
 from logging.handlers import TimedRotatingFileHandler
-from time import time
+from time import time, perf_counter
 from pathlib import Path
-from itertools import cycle
+from itertools import cycle, count
 from colorama import init, Fore, Style
 from pynput import keyboard
 
@@ -24,6 +25,10 @@ REPO_ROOT   = Path(__file__).parent.parent.parent
 CONFIG_PATH = REPO_ROOT / "config.toml"
 VERSION     = (REPO_ROOT / "VERSION").read_text().strip()
 LOG_DIR     = Path(__file__).parent / "logs"
+ESTOP       = b"\x18"   # out-of-band emergency stop, caught by the firmware's RX interrupt
+
+TRACE_RE = re.compile(r"\^TRACE \[id=(\d+) rx=\d+ dispatch=\+(\d+) step=\+(\d+)\]")
+PING_RE  = re.compile(r"\[Ping\] h=(\d+) rx=(\d+) dispatch=(\d+).* now=(\d+)")
 
 
 def setup_logger():
@@ -44,6 +49,19 @@ def load_config():
         return tomllib.load(f)
 
 
+def server_address(cfg, device):
+    """Host and TCP port of the bridge; with several [[devices]], the port of the named table."""
+    host = cfg["network"]["host"]
+    if device is None:
+        return host, cfg["network"]["port"]
+    for d in cfg.get("devices", []):
+        if d["name"] == device:
+            return host, d["tcp_port"]
+    names = ", ".join(d["name"] for d in cfg.get("devices", [])) or "none configured"
+    print(Fore.RED + f"Unknown device '{device}' (config.toml [[devices]]: {names})")
+    sys.exit(1)
+
+
 def parse_key(key_str):
     """Convert a key name from config.toml to a pynput key object."""
     if len(key_str) == 1:
@@ -93,6 +111,8 @@ def print_menu(cfg):
         (Fore.GREEN   + f"←/→",          f"eje Y  (izq/der cámara)       [{keys['left']}/{keys['right']}]"),
         (Fore.MAGENTA + f"a/z",           f"eje Z  (arriba/abajo)          [{keys['z_up']}/{keys['z_down']}]"),
         (Fore.YELLOW  + "Shift + X/Y/Z", "ciclar velocidad del eje"),
+        (Fore.BLUE    + "R",             "grabar / terminar sesión de jog"),
+        (Fore.BLUE    + "P / Shift + P", "reproducir sesión (Shift: en bucle)"),
         (Fore.RED     + "ESC",           "parar todos los motores"),
         (Fore.RED     + "Q",             "salir del programa"),
     ]
@@ -115,6 +135,7 @@ class XYZClient:
         self.writer = None
         self._listen_task = None
         self._log   = log
+        self.traces = {}     # trace id -> {"key": t, "sent": t} (perf_counter)
 
     async def connect(self):
         if self.writer is not None:
@@ -122,11 +143,40 @@ class XYZClient:
         self.reader, self.writer = await asyncio.open_connection(self.host, self.port)
         print(Fore.CYAN + f"[Connected] {self.host}:{self.port}")
         self._listen_task = asyncio.create_task(self._listen(self._log))
+        await self.send(f"ping h={int(perf_counter() * 1e6)}")
+
+    async def estop(self):
+        """The e-stop byte alone: the firmware halts on it in its receive
+        interrupt and drops whatever input was still queued."""
+        await self.connect()
+        self.writer.write(ESTOP)
+        await self.writer.drain()
 
-    async def send(self, cmd):
+    async def send(self, cmd, trace_id=None):
         await self.connect()
         self.writer.write(f"{cmd}\r".encode())
         await self.writer.drain()
+        if trace_id in self.traces:
+            self.traces[trace_id]["sent"] = perf_counter()
+
+    def _log_trace(self, match, log):
+        """Per-hop latency of one traced run: keypress -> first STEP pulse."""
+        now   = perf_counter()
+        trace = self.traces.pop(int(match.group(1)), None)
+        if not trace or "sent" not in trace or not log:
+            return
+        key_to_sent = (trace["sent"] - trace["key"]) * 1000
+        sent_to_evt = (now - trace["sent"]) * 1000
+        log.info(f"TRACE id={match.group(1)} key->sent={key_to_sent:.2f}ms "
+                 f"sent->^TRACE={sent_to_evt:.2f}ms fw_dispatch={int(match.group(2)) / 1000:.2f}ms "
+                 f"fw_step={int(match.group(3)) / 1000:.2f}ms")
+
+    def _log_ping(self, match, log):
+        """Round trip of the connect-time ping, and the firmware clock at receive."""
+        rtt = perf_counter() * 1000 - int(match.group(1)) / 1000
+        if log:
+            log.info(f"PING rtt={rtt:.2f}ms fw_rx={match.group(2)}us "
+                     f"fw_dispatch->reply={(int(match.group(4)) - int(match.group(3))) / 1000:.2f}ms")
 
     async def _listen(self, log=None):
         """Print messages arriving from the server (Arduino responses and events)."""
@@ -138,13 +188,23 @@ class XYZClient:
                     if log:
                         log.warning("Server closed connection")
                     break
-                msg = line.decode(errors="ignore").strip()
+                # Events can follow the prompt and ETX on the same line ("\x03\n>^...").
+                msg = line.decode(errors="ignore").strip().lstrip("\x03>")
                 if not msg:
                     continue
+                if msg.startswith("^TRACE"):
+                    match = TRACE_RE.search(msg)
+                    if match:
+                        self._log_trace(match, log)
+                    continue
+                match = PING_RE.search(msg)
+                if match:
+                    self._log_ping(match, log)
+                    continue
                 if msg.startswith("^"):
                     tag = msg[1:]
                     # Highlight and log safety-critical messages
-                    if any(w in tag for w in ("LIMIT", "RETRACT", "SECURITY")):
+                    if any(w in tag for w in ("LIMIT", "RETRACT", "SECURITY", "STALL", "ESTOP")):
                         print(Fore.RED + Style.BRIGHT + f"[!] {tag}")
                         if log:
                             log.warning(f"FIRMWARE EVENT: {tag}")
@@ -171,36 +231,74 @@ class XYZClient:
 
 
 async def main():
+    parser = argparse.ArgumentParser(description="Keyboard jog client")
+    parser.add_argument("--device", help="table name from config.toml [[devices]]")
+    args   = parser.parse_args()
+
     cfg    = load_config()
     log    = setup_logger()
     keymap = load_keymap(cfg)
     speeds = load_speeds(cfg)
-    client = XYZClient(cfg["network"]["host"], cfg["network"]["port"], log=log)
+    host, port = server_address(cfg, args.device)
+    client = XYZClient(host, port, log=log)
     loop   = asyncio.get_running_loop()
 
     log.info(f"=== Session started  v{VERSION} ===")
-    log.info(f"Connecting to {cfg['network']['host']}:{cfg['network']['port']}")
+    log.info(f"Connecting to {host}:{port}")
 
     active_keys         = {}                              # key → axis currently running
     press_times         = {}                              # key → timestamp of press
     modifiers           = set()                           # active modifiers (shift)
     shift_speed_fired   = {"x": False, "y": False, "z": False}  # debounce speed toggle
+    session_keys_fired  = set()                           # debounce R / P
+    recording           = [False]
+    trace_ids           = count()                         # run t=<id>, see ^TRACE
+    chord_s             = cfg["keys"].get("chord_ms", 0) / 1000
+    chord               = []                              # [trace_id, cmd, ...] waiting for the window
 
-    async def _send(cmd):
+    async def _send(cmd, trace_id=None, estop=False):
         try:
-            await client.send(cmd)
+            if estop:
+                await client.estop()
+            else:
+                await client.send(cmd, trace_id)
         except Exception as e:
             print(Fore.RED + f"[Send error] {e}")
             log.error(f"Send error: {e}")
 
+    def _flush_chord():
+        trace_id, *cmds = chord
+        chord.clear()
+        asyncio.ensure_future(_send("; ".join(cmds), trace_id))
+
+    def send_key_command(cmd, trace_id=None):
+        """Keys pressed within chord_ms go out as one batch ('run x; run -y'),
+        so the firmware starts those axes on the same tick. Only the first
+        command of a batch is traced."""
+        if chord:
+            chord.append(cmd)
+            client.traces.pop(trace_id, None)
+            return
+        if trace_id is not None:
+            cmd = f"{cmd} t={trace_id}"
+        if chord_s > 0 and trace_id is not None:
+            chord.extend([trace_id, cmd])
+            loop.call_soon_threadsafe(loop.call_later, chord_s, _flush_chord)
+        else:
+            asyncio.run_coroutine_threadsafe(_send(cmd, trace_id), loop)
+
     def run_axis(key):
         if key in active_keys:
             return
         axis, sign = keymap[key]
         active_keys[key] = axis
         press_times[key]  = time()
+        trace_id = next(trace_ids) % 0xFFFF + 1          # firmware keeps 16 bits, 0 = none
+        client.traces[trace_id] = {"key": perf_counter()}
+        while len(client.traces) > 64:                   # runs stopped before any step
+            client.traces.pop(next(iter(client.traces)))
         cmd = f"run {axis}" if sign == "+" else f"run -{axis}"
-        asyncio.run_coroutine_threadsafe(_send(cmd), loop)
+        send_key_command(cmd, trace_id)
         print(Fore.YELLOW + f"[RUN] {axis.upper()}  {'(+)' if sign == '+' else '(-)'}")
         log.info(f"RUN {axis.upper()} {'(+)' if sign == '+' else '(-)'}")
 
@@ -210,17 +308,17 @@ async def main():
             return
         duration = time() - press_times.pop(key, time())
         # Always send stop — regardless of how long the key was held
-        asyncio.run_coroutine_threadsafe(_send(f"stop {axis}"), loop)
+        send_key_command(f"stop {axis}")
         flag = "  [long press]" if duration > 3.0 else ""
         print(Fore.GREEN + f"[STOP] {axis.upper()}  {duration:.2f}s{flag}")
         log.info(f"STOP {axis.upper()}  duration={duration:.2f}s{flag.strip()}")
 
-    def stop_all():
+    def stop_all(estop=False):
         for k in list(active_keys):
             active_keys.pop(k, None)
             press_times.pop(k, None)
-        asyncio.run_coroutine_threadsafe(_send("stop"), loop)
-        log.info("STOP ALL")
+        asyncio.run_coroutine_threadsafe(_send(None, estop=True) if estop else _send("stop"), loop)
+        log.info("ESTOP ALL" if estop else "STOP ALL")
 
     def toggle_speed(axis):
         if axis not in speeds:
@@ -234,6 +332,22 @@ async def main():
         print(Fore.CYAN + f"[Speed] {axis.upper()} → {speed} steps/s  ({idx}/{total})")
         log.info(f"SPEED {axis.upper()} -> {speed} steps/s ({idx}/{total})")
 
+    def session_key(char):
+        """R toggles the firmware's jog recorder, P replays the recording
+        (Shift + P: looped, until ESC)."""
+        if char in session_keys_fired:
+            return
+        session_keys_fired.add(char)
+        if char == "r":
+            recording[0] = not recording[0]
+            cmd = "rec start" if recording[0] else "rec stop"
+            print(Fore.BLUE + ("[REC] Recording jog session" if recording[0] else "[REC] Recording stopped"))
+        else:
+            cmd = "replay loop" if "shift" in modifiers else "replay"
+            print(Fore.BLUE + f"[REPLAY] {'Looping' if 'shift' in modifiers else 'Replaying'} recorded session")
+        asyncio.run_coroutine_threadsafe(_send(cmd), loop)
+        log.info(cmd.upper())
+
     def on_press(key):
         # --- Shift modifier ---
         if key in (keyboard.Key.shift, keyboard.Key.shift_r):
@@ -259,6 +373,11 @@ async def main():
         # --- Movement keys ---
         if key in keymap:
             run_axis(key)
+            return
+
+        # --- R / P: record / replay the jog session ---
+        if isinstance(key, keyboard.KeyCode) and key.char and key.char.lower() in ("r", "p"):
+            session_key(key.char.lower())
 
     def on_release(key):
         # --- Shift released: clear modifier and speed-toggle debounce ---
@@ -268,11 +387,14 @@ async def main():
                 shift_speed_fired[axis] = False
             return
 
+        if isinstance(key, keyboard.KeyCode) and key.char:
+            session_keys_fired.discard(key.char.lower())
+
         # --- ESC: emergency stop all axes ---
         if key == keyboard.Key.esc:
             print(Fore.RED + Style.BRIGHT + "[ESC] Emergency stop!")
             log.warning("ESC emergency stop triggered by user")
-            stop_all()
+            stop_all(estop=True)
             return
 
         # --- Release movement key: stop that axis ---
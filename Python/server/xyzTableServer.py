@@ -1,12 +1,17 @@
+import random
+import re
 import socket
+import string
 import serial
 import serial.tools.list_ports
 import select
 import sys
 import logging
-from logging.handlers import TimedRotatingFileHandler
+import queue
+from logging.handlers import TimedRotatingFileHandler, QueueHandler, QueueListener
 from datetime import datetime
 from pathlib import Path
+from time import perf_counter
 from colorama import init, Fore, Style
 
 try:
@@ -25,6 +30,22 @@ CONFIG_PATH = REPO_ROOT / "config.toml"
 LOG_DIR     = Path(__file__).parent / "logs"
 VERSION     = (REPO_ROOT / "VERSION").read_text().strip()
 
+ETX              = b"\x03"   # end of every firmware reply / event
+CMD_END          = b"\r"     # end of every command line
+ESTOP            = b"\x18"   # BOARD_ESTOP_BYTE: stops the table from the firmware's RX interrupt
+FRAME_FLUSH_S    = 0.02      # forward unterminated serial output after this idle time
+STATS_INTERVAL_S = 60        # forwarding-latency and health summary period
+SERIAL_RETRY_S   = 5         # retry period for a serial port that is missing or lost
+BAUD_RATES       = (115200, 250000, 500000, 1000000, 2000000)  # 'baud' rates (MegaBoard.cpp)
+BAUD_CONFIRM_S   = 1.0       # BOARD_BAUD_CONFIRM_MS: unconfirmed, the firmware falls back
+BAUD_CHECKS      = 3         # CRC'd echo round trips before a new rate is kept
+PROBE_S          = 4.0       # a Mega resets when its port opens: bootloader + start-up delay
+LINK_SILENT_S    = 1.0       # no reply this long at a negotiated rate: the firmware has reset
+COALESCE_S       = 0.03      # per axis: at most one run / setting change per key this often
+
+TRACE_CMD_RE   = re.compile(rb"(?:^|\s)t=(\d+)")
+TRACE_EVENT_RE = re.compile(rb"\^TRACE \[id=(\d+) rx=\d+ dispatch=\+(\d+) step=\+(\d+)\]")
+
 
 def load_config():
     with open(CONFIG_PATH, "rb") as f:
@@ -32,6 +53,11 @@ def load_config():
 
 
 def setup_logger():
+    """Logger whose records are written by a background thread.
+
+    The bridge loop only enqueues; formatting and SD-card writes never
+    delay forwarding. Stop the returned listener on exit to flush.
+    """
     LOG_DIR.mkdir(exist_ok=True)
     logger = logging.getLogger("xyzTableServer")
     logger.setLevel(logging.DEBUG)
@@ -45,25 +71,55 @@ def setup_logger():
     console_handler = logging.StreamHandler()
     console_handler.setFormatter(logging.Formatter("[%(levelname)s] %(message)s"))
 
-    logger.addHandler(file_handler)
-    logger.addHandler(console_handler)
-    return logger
+    log_queue = queue.SimpleQueue()
+    listener  = QueueListener(log_queue, file_handler, console_handler, respect_handler_level=True)
+    listener.start()
+    logger.addHandler(QueueHandler(log_queue))
+    return logger, listener
+
+
+def load_devices(cfg):
+    """Tables to serve: every [[devices]] entry, or the single [serial] port.
 
+    Each device has its own serial port and its own TCP port; a client
+    reaches a table by connecting to that table's port.
+    """
+    host     = cfg["network"]["host"]
+    baudrate = cfg["serial"]["baudrate"]
+    max_baud = cfg["serial"].get("max_baudrate", baudrate)
+    entries  = cfg.get("devices") or [{
+        "name": "table", "port": cfg["serial"]["port"], "tcp_port": cfg["network"]["port"],
+    }]
+    return [dict(name=d["name"], port=d["port"], baudrate=d.get("baudrate", baudrate),
+                 max_baudrate=d.get("max_baudrate", max_baud),
+                 host=host, tcp_port=d["tcp_port"]) for d in entries]
 
-def print_banner(cfg):
+
+def print_banner(devices):
     print(Fore.CYAN + Style.BRIGHT + f"\n=== xyzTableServer v{VERSION} ===")
     print(Fore.YELLOW + "TCP <-> Serial bridge for Arduino Mega")
     print(Fore.BLUE   + f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}\n")
-    print(Fore.GREEN  + f"  Serial port : {Fore.WHITE}{cfg['serial']['port']}")
-    print(Fore.GREEN  + f"  Baudrate    : {Fore.WHITE}{cfg['serial']['baudrate']}")
-    print(Fore.GREEN  + f"  TCP host    : {Fore.WHITE}{cfg['network']['host']}")
-    print(Fore.GREEN  + f"  TCP port    : {Fore.WHITE}{cfg['network']['port']}\n")
+    for d in devices:
+        rate = f"{d['baudrate']}" + (f"-{d['max_baudrate']}" if d["max_baudrate"] > d["baudrate"] else "")
+        print(Fore.GREEN + f"  {d['name']:<12}: {Fore.WHITE}{d['port']} @ {rate} bps"
+                           f"  <->  {d['host']}:{d['tcp_port']}")
+    print()
 
 
 def list_serial_ports():
     return [p.device for p in serial.tools.list_ports.comports()]
 
 
+def crc16(data):
+    """avr-libc's _crc16_update from 0xFFFF: the CRC of 'baud check'."""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
 def stop_motors(ser, logger):
     try:
         ser.write(b"stop\r")
@@ -73,68 +129,564 @@ def stop_motors(ser, logger):
         logger.warning(f"Could not send stop command: {e}")
 
 
-def serve(cfg, ser, logger):
-    host = cfg["network"]["host"]
-    port = cfg["network"]["port"]
+class HopTracer:
+    """Logs bridge hops of traced commands ('run ... t=<id>').
 
-    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-    server.bind((host, port))
-    server.listen(1)
-    logger.info(f"TCP server listening on {host}:{port}")
-    print(Fore.CYAN + f"[INFO] Listening on {host}:{port}")
+    For each trace ID: TCP receive -> serial write (time spent in the
+    bridge), and serial write -> ^TRACE read back, split using the
+    firmware's own dispatch / first-step offsets.
+    """
 
-    while True:
-        print(Fore.YELLOW + "\n[WAIT] Waiting for client connection...")
-        client_sock, addr = server.accept()
-        logger.info(f"Client connected from {addr}")
-        print(Fore.CYAN + f"[CONN] Client connected from {addr}")
+    def __init__(self, logger):
+        self.logger  = logger
+        self.pending = {}        # id -> (tcp_rx, serial_tx)
+        self.buffer  = b""
+
+    def command(self, data, tcp_rx, serial_tx):
+        for m in TRACE_CMD_RE.finditer(data):
+            self.pending[int(m.group(1))] = (tcp_rx, serial_tx)
+        while len(self.pending) > 64:
+            self.pending.pop(next(iter(self.pending)))
+
+    def serial(self, data, serial_rx):
+        *lines, self.buffer = (self.buffer + data).split(b"\n")
+        self.buffer = self.buffer[-256:]
+        for line in lines:
+            m = TRACE_EVENT_RE.search(line)
+            if not m:
+                continue
+            trace_id = int(m.group(1))
+            hops = self.pending.pop(trace_id, None)
+            if hops is None:
+                continue
+            tcp_rx, serial_tx = hops
+            self.logger.info(
+                f"[TRACE] id={trace_id} bridge={(serial_tx - tcp_rx) * 1000:.2f}ms "
+                f"serial_rtt={(serial_rx - serial_tx) * 1000:.2f}ms "
+                f"fw_dispatch={int(m.group(2)) / 1000:.2f}ms fw_step={int(m.group(3)) / 1000:.2f}ms")
+
+
+class Coalescer:
+    """Holds back jog commands that a newer one makes moot.
+
+    'run <axis>' and 'axe <axis> <setting>=<value>' lines are keyed by axis
+    (and setting). Each axis may send one such line every COALESCE_S; one
+    arriving sooner waits, and a newer line with the same key replaces it.
+    Lines with a 'stop' go out at once and drop the waiting runs of the axes
+    they stop. Any other line releases everything waiting first, so the
+    order the firmware sees changes only for superseded commands.
+    """
+
+    def __init__(self):
+        self.pending   = {}        # key -> (line, axis, tcp_rx)
+        self.last_sent = {}        # axis -> when its last jog line went out
+        self.coalesced = 0         # since start
+
+    @staticmethod
+    def parse(line):
+        """(kind, axis, key) of each ';'-separated command, lower case."""
+        out = []
+        for part in line.decode(errors="ignore").strip().lower().split(";"):
+            tokens = part.split()
+            if not tokens:
+                continue
+            axis = tokens[1].lstrip("-") if len(tokens) > 1 else "all"
+            if tokens[0] == "run":
+                out.append(("run", axis, ("run", axis)))
+            elif tokens[0] == "axe" and len(tokens) == 3 and "=" in tokens[2]:
+                out.append(("axe", axis, ("axe", axis, tokens[2].split("=")[0])))
+            else:
+                out.append((tokens[0], axis, None))
+        return out
+
+    def due(self, axis):
+        return self.last_sent.get(axis, 0.0) + COALESCE_S
+
+    def submit(self, line, tcp_rx):
+        """(line, tcp_rx) to write now, in order; the rest waits for release()."""
+        cmds = self.parse(line)
+        if len(cmds) == 1 and cmds[0][2] is not None and cmds[0][1] != "all":
+            _, axis, key = cmds[0]
+            if key in self.pending:
+                self.coalesced += 1
+            elif self.due(axis) <= tcp_rx and all(a != axis for _, a, _ in self.pending.values()):
+                self.last_sent[axis] = tcp_rx
+                return [(line, tcp_rx)]
+            self.pending[key] = (line, axis, tcp_rx)
+            return []
+
+        if any(kind == "stop" for kind, _, _ in cmds):
+            for kind, axis, key in cmds:
+                for k in [k for k, (_, a, _) in self.pending.items()
+                          if k == key or (kind == "stop" and k[0] == "run" and axis in (a, "all"))]:
+                    del self.pending[k]
+                    self.coalesced += 1
+            return [(line, tcp_rx)]
+
+        out = [(held, rx) for held, _, rx in self.pending.values()] + [(line, tcp_rx)]
+        self.pending.clear()
+        return out
+
+    def release(self, now):
+        """Waiting lines whose axis may send again, oldest key first."""
+        out = []
+        for key, (line, axis, rx) in list(self.pending.items()):
+            if self.due(axis) <= now:
+                del self.pending[key]
+                self.last_sent[axis] = now
+                out.append((line, rx))
+        return out
+
+    def next_due(self):
+        return min((self.due(axis) for _, axis, _ in self.pending.values()), default=None)
+
+    def drop_runs(self):
+        """After an e-stop nothing held may start an axis again."""
+        for key in [k for k in self.pending if k[0] == "run"]:
+            del self.pending[key]
+            self.coalesced += 1
+
+    def settings(self):
+        """Takes the waiting 'axe' lines, dropping the runs: what still
+        has to reach the firmware when the client goes away."""
+        out = [(line, rx) for key, (line, _, rx) in self.pending.items() if key[0] == "axe"]
+        self.pending.clear()
+        return out
+
+    def clear(self):
+        self.pending.clear()
+
+
+class LatencyStats:
+    """Forwarding latency of one direction: last byte of a message read -> written out."""
+
+    def __init__(self, name):
+        self.name    = name
+        self.samples = []
+
+    def add(self, seconds):
+        self.samples.append(seconds * 1000)
+
+    def report(self, logger):
+        if not self.samples:
+            return
+        s = sorted(self.samples)
+        n = len(s)
+        logger.info(f"[STATS] {self.name}: n={n} mean={sum(s) / n:.3f}ms p50={s[n // 2]:.3f}ms "
+                    f"p99={s[min(n - 1, int(n * 0.99))]:.3f}ms max={s[-1]:.3f}ms")
+        self.samples.clear()
+
+
+class DeviceHealth:
+    """Throughput and error counters of one device since its last report."""
+
+    def __init__(self):
+        self.commands      = 0     # lines forwarded TCP -> serial
+        self.frames        = 0     # replies / events forwarded serial -> TCP
+        self.bytes_tx      = 0     # bytes written to the serial port
+        self.bytes_rx      = 0     # bytes read from the serial port
+        self.serial_errors = 0
+        self.coalesced     = 0     # superseded jog commands never sent
+
+    def report(self, device, logger):
+        serial_state = "up" if device.ser else "DOWN"
+        client_state = f"{device.addr[0]}:{device.addr[1]}" if device.client else "none"
+        logger.info(f"[HEALTH] {device.name}: serial={serial_state} client={client_state} "
+                    f"cmds={self.commands} coalesced={self.coalesced} frames={self.frames} "
+                    f"tx={self.bytes_tx}B rx={self.bytes_rx}B errors={self.serial_errors}")
+        self.__init__()
+
+
+class Device:
+    """One table: its serial port, its TCP listener and at most one client."""
+
+    def __init__(self, name, port, baudrate, max_baudrate, host, tcp_port, logger):
+        self.name     = name
+        self.port     = port
+        self.baudrate = baudrate   # starting rate; the link may run faster (see negotiate())
+        self.max_baud = max_baudrate
+        self.logger   = logger
+        self.ser      = None
+        self.retry_at = 0.0        # next attempt to (re)open a lost serial port
+        self.retrying = False      # open failures after the first are not logged
+        self.client   = None
+        self.addr     = None
+
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind((host, tcp_port))
+        self.server.listen(1)
+        logger.info(f"[{name}] TCP server listening on {host}:{tcp_port}")
+
+        self.cmd_buf   = b""       # TCP bytes up to the next '\r' (one command)
+        self.frame_buf = b""       # serial bytes up to the next ETX (one reply/event)
+        self.frame_at  = 0.0       # when frame_buf last grew
+        self.awaiting  = 0.0       # first command sent since the last reply, 0 = none
+        self.link      = None      # negotiate() while it runs, see step_link()
+        self.link_line = None      # line whose reply the negotiation waits for
+        self.link_buf  = b""       # serial bytes of that reply
+        self.link_due  = 0.0       # when the negotiation resumes without a reply
+        self.tracer    = HopTracer(logger)
+        self.coalescer = Coalescer()
+        self.to_ser    = LatencyStats(f"{name} TCP->SERIAL")
+        self.to_tcp    = LatencyStats(f"{name} SERIAL->TCP")
+        self.health    = DeviceHealth()
 
+    def open_serial(self):
         try:
-            while True:
-                # Wait for data from either the TCP client or the Arduino serial port
-                readable, _, _ = select.select([client_sock, ser], [], [], 0.01)
-
-                for src in readable:
-                    if src is client_sock:
-                        data = client_sock.recv(1024)
-                        if not data:
-                            raise ConnectionResetError("Client closed connection")
-                        ser.write(data)
-                        logger.debug(f"[TCP->SERIAL] {data!r}")
-
-                    elif src is ser:
-                        data = ser.read(ser.in_waiting or 1)
-                        if data:
-                            client_sock.sendall(data)
-                            logger.debug(f"[SERIAL->TCP] {data!r}")
-
-        except (ConnectionResetError, BrokenPipeError):
-            logger.info(f"Client {addr} disconnected")
-            print(Fore.RED + f"[DISC] Client {addr} disconnected")
+            self.ser = serial.Serial(self.port, self.baudrate, timeout=0)
+        except serial.SerialException as e:
+            if not self.retrying:
+                self.logger.error(f"[{self.name}] Could not open serial port '{self.port}': {e}")
+            self.retrying = True
+            self.retry_at = perf_counter() + SERIAL_RETRY_S
+            return False
+        self.retrying = False
+        self.logger.info(f"[{self.name}] Connected to Arduino on {self.port} at {self.baudrate} bps")
+        print(Fore.GREEN + f"[OK] {self.name}: Arduino connected on {self.port}")
+        try:
+            self.start_link()
+        except serial.SerialException as e:
+            self.serial_lost(e)
+            return False
+        return True
+
+    # The negotiation is a generator stepped by the bridge loop, so it never
+    # holds up the other tables. It yields (line, timeout) to send `line` and
+    # wait for the reply, or (None, seconds) to pause, and is resumed with
+    # the reply, or None once the time is up. Meanwhile the client is still
+    # read: the e-stop byte goes out at once, command lines wait for the link.
+
+    def start_link(self):
+        self.link = self.negotiate()
+        self.step_link(None)
+
+    def step_link(self, reply):
+        try:
+            line, wait = self.link.send(reply)
+        except StopIteration:
+            self.link     = None
+            self.awaiting = 0.0
+            if self.client:
+                self.forward_lines(b"", perf_counter())   # the lines held meanwhile
+            return
+        self.link_line = line
+        self.link_buf  = b""
+        self.link_due  = perf_counter() + wait
+        if line is not None:
+            self.serial_io(self.ser.write, line.encode() + CMD_END)
+
+    def link_readable(self):
+        """Serial input during the negotiation: the reply to its line, found by
+        the echo. Frames without the echo are dropped."""
+        self.link_buf += self.serial_io(lambda: self.ser.read(self.ser.in_waiting or 1))
+        while self.link and self.link_line and ETX in self.link_buf:
+            frame, self.link_buf = self.link_buf.split(ETX, 1)
+            _, echo, reply = frame.decode(errors="ignore").partition(self.link_line)
+            if echo:
+                self.step_link(reply.strip("\r\n>").strip())
+
+    @staticmethod
+    def exchange(line, timeout=0.3):
+        """Negotiation step: the reply to `line` without its echo, or None."""
+        return (yield (line, timeout))
+
+    @staticmethod
+    def pause(seconds):
+        yield (None, seconds)
+
+    def probe(self):
+        """Finds the rate the firmware listens at: the starting rate, retried
+        while a Mega that reset on open boots, then the other 'baud' rates."""
+        deadline = perf_counter() + PROBE_S
+        while perf_counter() < deadline:
+            self.ser.write(CMD_END)          # ends a line garbled by a wrong rate
+            if (yield from self.exchange("version", 0.5)) is not None:
+                return True
+        for rate in BAUD_RATES:
+            if rate == self.baudrate:
+                continue
+            self.ser.baudrate = rate
+            self.ser.reset_input_buffer()
+            self.ser.write(CMD_END)
+            if (yield from self.exchange("version")) is not None:
+                return True
+        self.ser.baudrate = self.baudrate
+        return False
+
+    def check_link(self):
+        """CRC'd echo test: the firmware checks our CRC of a random line and
+        sends the line back with its own CRC, so both directions are covered."""
+        for _ in range(BAUD_CHECKS):
+            text  = "".join(random.choices(string.ascii_letters + string.digits, k=48))
+            crc   = f"{crc16(text.encode()):04X}"
+            reply = yield from self.exchange(f"baud check {text} {crc}")
+            if reply != f"[Baud] check {text} {crc} ok":
+                return False
+        return True
+
+    def negotiate(self):
+        """Moves the link from the starting rate up to max_baudrate: 'baud
+        <rate>', CRC'd echo checks at the new rate, then 'baud ok'. If any step
+        fails, both ends fall back; the firmware does so on its own when the
+        'baud ok' never comes. Stepped by step_link()."""
+        self.ser.baudrate = self.baudrate
+        self.ser.reset_input_buffer()
+        if not (yield from self.probe()):
+            self.logger.warning(f"[{self.name}] No reply from the firmware, staying at {self.baudrate} bps")
+            return
+        rate   = self.ser.baudrate
+        target = max([r for r in BAUD_RATES if r <= self.max_baud], default=rate)
+        if target <= rate:
+            return
+
+        reply = yield from self.exchange(f"baud {target}")
+        if not reply or "Switching" not in reply:
+            self.logger.warning(f"[{self.name}] Firmware did not switch to {target} bps ({reply}), "
+                                f"staying at {rate} bps")
+            return
+        yield from self.pause(0.02)          # it switches once its prompt has gone out
+        self.ser.baudrate = target
+        self.ser.reset_input_buffer()
+        self.ser.write(CMD_END)
+        if (yield from self.check_link()) and "confirmed" in ((yield from self.exchange("baud ok")) or ""):
+            self.logger.info(f"[{self.name}] Link at {target} bps, CRC echo test passed")
+            return
+
+        self.logger.warning(f"[{self.name}] Link check failed at {target} bps, falling back to {rate} bps")
+        yield from self.pause(BAUD_CONFIRM_S + 0.2)
+        self.ser.baudrate = rate
+        self.ser.reset_input_buffer()
+        if not (yield from self.probe()):    # 'baud ok' got through after all?
+            self.logger.warning(f"[{self.name}] Firmware lost after the fallback")
+
+    def serial_lost(self, error):
+        self.logger.error(f"[{self.name}] Serial port {self.port} lost: {error}")
+        print(Fore.RED + f"[ERROR] {self.name}: serial port {self.port} lost")
+        self.health.serial_errors += 1
+        self.ser.close()
+        self.ser      = None
+        self.link     = None
+        self.retry_at = perf_counter() + SERIAL_RETRY_S
+        if self.client:
+            self.disconnect("serial port lost")
+
+    def readers(self):
+        """Sockets / ports this device waits on in the shared select()."""
+        if not self.ser:
+            return []
+        if not self.client:
+            # No client: leave events queued in the serial buffer, unless negotiating.
+            return [self.server, self.ser] if self.link else [self.server]
+        return [self.client, self.ser]
+
+    def timeout(self, now):
+        """Seconds until this device needs a wake-up without input, or None."""
+        if not self.ser:
+            return max(0.0, self.retry_at - now)
+        due = []
+        if self.link:
+            due.append(self.link_due)
+        if self.client and self.frame_buf:
+            due.append(self.frame_at + FRAME_FLUSH_S)
+        if self.client and self.coalescer.pending:
+            due.append(self.coalescer.next_due())
+        if self.awaiting and not self.link and self.ser.baudrate != self.baudrate:
+            due.append(self.awaiting + LINK_SILENT_S)
+        return max(0.0, min(due) - now) if due else None
+
+    def accept(self):
+        self.client, self.addr = self.server.accept()
+        # Jog commands are a few bytes: send them now, don't wait for Nagle.
+        self.client.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.cmd_buf   = b""
+        self.frame_buf = b""
+        self.coalescer.clear()
+        self.logger.info(f"[{self.name}] Client connected from {self.addr}")
+        print(Fore.CYAN + f"[CONN] {self.name}: client connected from {self.addr}")
+
+    def disconnect(self, reason):
+        self.logger.info(f"[{self.name}] Client {self.addr} disconnected ({reason})")
+        print(Fore.RED + f"[DISC] {self.name}: client {self.addr} disconnected")
+        if self.ser:
+            try:
+                for line, rx in self.coalescer.settings():
+                    self.write_line(line, rx)
+            except serial.SerialException as e:
+                self.logger.warning(f"[{self.name}] Could not send held settings: {e}")
+            stop_motors(self.ser, self.logger)
+        self.coalescer.clear()
+        self.client.close()
+        self.client = None
+        self.report()
+        self.logger.info(f"[{self.name}] Connection with {self.addr} closed")
+
+    @staticmethod
+    def serial_io(op, *args):
+        """Runs a serial read/write; a vanished port raises SerialException, never a bare OSError."""
+        try:
+            return op(*args)
         except OSError as e:
-            logger.error(f"Socket error with {addr}: {e}")
-        finally:
-            stop_motors(ser, logger)
-            client_sock.close()
-            logger.info(f"Connection with {addr} closed")
+            if isinstance(e, serial.SerialException):
+                raise
+            raise serial.SerialException(str(e)) from e
+
+    def client_readable(self):
+        data = self.client.recv(1024)
+        if not data:
+            raise ConnectionResetError("Client closed connection")
+        tcp_rx = perf_counter()
+        # The e-stop byte is not part of any line: it goes out right after the
+        # lines completed before it, without waiting for a '\r'. As in the
+        # firmware, a line it interrupts is dropped, and so are the held runs.
+        *before_estop, rest = data.split(ESTOP)
+        for part in before_estop:
+            self.forward_lines(part, tcp_rx)
+            self.cmd_buf = b""
+            self.serial_io(self.ser.write, ESTOP)
+            self.health.bytes_tx += 1
+            held = self.coalescer.coalesced
+            self.coalescer.drop_runs()
+            self.health.coalesced += self.coalescer.coalesced - held
+            self.logger.warning(f"[{self.name}] [ESTOP] forwarded in "
+                                f"{(perf_counter() - tcp_rx) * 1000:.3f}ms")
+        self.forward_lines(rest, tcp_rx)
+
+    def forward_lines(self, data, tcp_rx):
+        self.cmd_buf += data
+        if self.link:
+            return                 # the port is negotiating: lines wait in cmd_buf
+        while CMD_END in self.cmd_buf:
+            line, self.cmd_buf = self.cmd_buf.split(CMD_END, 1)
+            line += CMD_END
+            before = self.coalescer.coalesced
+            for out, rx in self.coalescer.submit(line, tcp_rx):
+                self.write_line(out, rx)
+            if self.coalescer.coalesced != before:
+                self.health.coalesced += self.coalescer.coalesced - before
+                self.logger.debug(f"[{self.name}] [COALESCED] superseded by {line!r}")
+
+    def write_line(self, line, tcp_rx):
+        self.serial_io(self.ser.write, line)
+        serial_tx = perf_counter()
+        self.to_ser.add(serial_tx - tcp_rx)
+        self.awaiting = self.awaiting or serial_tx
+        self.tracer.command(line, tcp_rx, serial_tx)
+        self.health.commands += 1
+        self.health.bytes_tx += len(line)
+        self.logger.debug(f"[{self.name}] [TCP->SERIAL] {line!r}")
+
+    def serial_readable(self):
+        data = self.serial_io(lambda: self.ser.read(self.ser.in_waiting or 1))
+        if not data:
+            return
+        serial_rx = perf_counter()
+        self.tracer.serial(data, serial_rx)
+        self.health.bytes_rx += len(data)
+        self.frame_buf += data
+        self.frame_at   = serial_rx
+        while ETX in self.frame_buf:
+            frame, self.frame_buf = self.frame_buf.split(ETX, 1)
+            frame += ETX
+            self.awaiting = 0.0
+            self.client.sendall(frame)
+            self.to_tcp.add(perf_counter() - serial_rx)
+            self.health.frames += 1
+            self.logger.debug(f"[{self.name}] [SERIAL->TCP] {frame!r}")
+
+    def service(self, readable, now):
+        """Handles this device's ready inputs and timers; never blocks."""
+        if not self.ser:
+            if now >= self.retry_at:
+                self.open_serial()
+            return
+
+        if self.server in readable:
+            self.accept()
+            return
+
+        try:
+            if self.link:
+                if self.ser in readable:
+                    self.link_readable()
+                if self.link and perf_counter() >= self.link_due:
+                    self.step_link(None)
+            if not self.client:
+                return
+            # A reset brings the firmware back at the starting rate.
+            if (self.awaiting and not self.link and self.ser.baudrate != self.baudrate
+                    and perf_counter() - self.awaiting >= LINK_SILENT_S):
+                self.logger.warning(f"[{self.name}] No reply at {self.ser.baudrate} bps, renegotiating")
+                self.awaiting = 0.0
+                self.start_link()
+            if self.client in readable:
+                self.client_readable()
+            if self.link:
+                return
+            for line, rx in self.coalescer.release(perf_counter()):
+                self.write_line(line, rx)
+            if self.ser in readable:
+                self.serial_readable()
+            # Unterminated output (prompt, echo of a half-typed line): pass it on.
+            if self.frame_buf and perf_counter() - self.frame_at >= FRAME_FLUSH_S:
+                self.client.sendall(self.frame_buf)
+                self.logger.debug(f"[{self.name}] [SERIAL->TCP] {self.frame_buf!r}")
+                self.frame_buf = b""
+        except serial.SerialException as e:
+            self.serial_lost(e)
+        except (ConnectionResetError, BrokenPipeError) as e:
+            self.disconnect(e)
+        except OSError as e:
+            self.logger.error(f"[{self.name}] Socket error with {self.addr}: {e}")
+            self.disconnect(e)
+
+    def report(self):
+        self.to_ser.report(self.logger)
+        self.to_tcp.report(self.logger)
+        self.health.report(self, self.logger)
+
+    def close(self):
+        if self.ser:
+            stop_motors(self.ser, self.logger)
+            self.ser.close()
+        if self.client:
+            self.client.close()
+        self.server.close()
+
+
+def serve(devices, logger):
+    """Single event loop for every device: blocks in select() until a port,
+    a client or a listener has input, or a device timer (partial-frame flush,
+    serial reopen, link negotiation step) is due."""
+    print(Fore.YELLOW + "\n[WAIT] Waiting for client connections...")
+    next_stats = perf_counter() + STATS_INTERVAL_S
+
+    while True:
+        now      = perf_counter()
+        timeouts = [t for t in (d.timeout(now) for d in devices) if t is not None]
+        timeouts.append(max(0.0, next_stats - now))
+        readers  = [r for d in devices for r in d.readers()]
+        readable, _, _ = select.select(readers, [], [], min(timeouts))
+
+        now = perf_counter()
+        for d in devices:
+            d.service(readable, now)
+
+        if now >= next_stats:
+            for d in devices:
+                d.report()
+            next_stats = now + STATS_INTERVAL_S
 
 
 def main():
     cfg = load_config()
-    logger = setup_logger()
-    print_banner(cfg)
+    logger, log_listener = setup_logger()
+    devices_cfg = load_devices(cfg)
+    print_banner(devices_cfg)
 
-    serial_port = cfg["serial"]["port"]
-    baudrate    = cfg["serial"]["baudrate"]
-
-    try:
-        ser = serial.Serial(serial_port, baudrate, timeout=0)
-        logger.info(f"Connected to Arduino on {serial_port} at {baudrate} bps")
-        print(Fore.GREEN + f"[OK] Arduino connected on {serial_port}")
-    except serial.SerialException as e:
-        logger.error(f"Could not open serial port '{serial_port}': {e}")
-        print(Fore.RED + f"\n[ERROR] Could not open '{serial_port}'")
+    devices = [Device(logger=logger, **d) for d in devices_cfg]
+    opened  = [d.open_serial() for d in devices]
+    if not all(opened):
         print(Fore.YELLOW + "\nAvailable serial ports:")
         ports = list_serial_ports()
         if ports:
@@ -142,16 +694,21 @@ def main():
                 print(Fore.CYAN + f"  - {p}")
         else:
             print(Fore.RED + "  No serial ports found. Is the Arduino connected?")
-        print(Fore.BLUE + f"\nEdit 'serial.port' in config.toml and restart.\n")
+    if not any(opened):
+        print(Fore.BLUE + f"\nEdit the serial port(s) in config.toml and restart.\n")
+        for d in devices:
+            d.close()
+        log_listener.stop()
         sys.exit(1)
 
     try:
-        serve(cfg, ser, logger)
+        serve(devices, logger)
     except KeyboardInterrupt:
         print(Fore.CYAN + "\n[EXIT] Server stopped by user.")
-        stop_motors(ser, logger)
     finally:
-        ser.close()
+        for d in devices:
+            d.close()
+        log_listener.stop()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,165 @@
+"""Load test for the TCP <-> Serial bridge.
+
+Drives xyzTableServer (normally in front of the firmware emulator, see
+Arduino/XYZ_Table_PlatformIO/emulator) and reports command round-trip
+latency and throughput. Every firmware reply ends with ETX (0x03); frames
+starting with '^' are asynchronous events and are not counted as replies.
+
+    python xyzLoadTest.py                         # 200 x "version", one at a time
+    python xyzLoadTest.py -n 500 -c "axe X" -c version
+    python xyzLoadTest.py --window 4 --duration 10
+"""
+
+import argparse
+import asyncio
+import statistics
+import sys
+from itertools import cycle
+from pathlib import Path
+from time import perf_counter
+
+try:
+    import tomllib
+except ImportError:
+    try:
+        import tomli as tomllib
+    except ImportError:
+        tomllib = None
+
+REPO_ROOT   = Path(__file__).parent.parent.parent
+CONFIG_PATH = REPO_ROOT / "config.toml"
+ETX         = b"\x03"
+
+
+def load_network():
+    if tomllib is None or not CONFIG_PATH.exists():
+        return "127.0.0.1", 5000
+    with open(CONFIG_PATH, "rb") as f:
+        net = tomllib.load(f).get("network", {})
+    return net.get("host", "127.0.0.1"), net.get("port", 5000)
+
+
+class FrameReader:
+    """Splits the byte stream into ETX frames, dropping '^' events."""
+
+    def __init__(self, reader):
+        self.reader = reader
+        self.events = 0
+        self.bytes  = 0
+
+    async def reply(self):
+        while True:
+            frame = await self.reader.readuntil(ETX)
+            self.bytes += len(frame)
+            text = frame[:-1].decode(errors="ignore").lstrip("\r\n>")
+            if text.startswith("^"):
+                self.events += 1
+                continue
+            return text
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    k = min(len(ordered) - 1, int(round(pct / 100 * (len(ordered) - 1))))
+    return ordered[k]
+
+
+def print_latency(rtts):
+    ms = [r * 1000 for r in rtts]
+    print(f"  replies : {len(ms)}")
+    print(f"  min     : {min(ms):8.2f} ms")
+    print(f"  median  : {statistics.median(ms):8.2f} ms")
+    print(f"  p95     : {percentile(ms, 95):8.2f} ms")
+    print(f"  p99     : {percentile(ms, 99):8.2f} ms")
+    print(f"  max     : {max(ms):8.2f} ms")
+
+
+async def run_sequential(reader, writer, frames, commands, count, timeout):
+    """One command in flight: pure round-trip latency."""
+    rtts = []
+    for cmd in (next(commands) for _ in range(count)):
+        start = perf_counter()
+        writer.write(f"{cmd}\r".encode())
+        await writer.drain()
+        await asyncio.wait_for(frames.reply(), timeout)
+        rtts.append(perf_counter() - start)
+    return rtts
+
+
+async def run_windowed(reader, writer, frames, commands, window, duration, timeout):
+    """Keeps `window` commands in flight for `duration` seconds."""
+    sent  = []
+    rtts  = []
+    start = perf_counter()
+
+    async def send_one():
+        writer.write(f"{next(commands)}\r".encode())
+        sent.append(perf_counter())
+        await writer.drain()
+
+    for _ in range(window):
+        await send_one()
+    while perf_counter() - start < duration:
+        await asyncio.wait_for(frames.reply(), timeout)
+        rtts.append(perf_counter() - sent[len(rtts)])
+        await send_one()
+    while len(rtts) < len(sent):
+        await asyncio.wait_for(frames.reply(), timeout)
+        rtts.append(perf_counter() - sent[len(rtts)])
+    return rtts, perf_counter() - start
+
+
+async def main():
+    host, port = load_network()
+    parser = argparse.ArgumentParser(description="Bridge latency and throughput test")
+    parser.add_argument("--host", default=host)
+    parser.add_argument("--port", type=int, default=port)
+    parser.add_argument("-c", "--command", action="append",
+                        help="command to send (repeat to cycle several; default: version)")
+    parser.add_argument("-n", "--count", type=int, default=200,
+                        help="commands in the sequential latency run")
+    parser.add_argument("--window", type=int, default=0,
+                        help="also run a throughput test with this many commands in flight")
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="seconds for the throughput test")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds to wait for a reply before giving up")
+    args = parser.parse_args()
+
+    commands = cycle(args.command or ["version"])
+    reader, writer = await asyncio.open_connection(args.host, args.port)
+    frames = FrameReader(reader)
+    print(f"Connected to {args.host}:{args.port}")
+
+    try:
+        print(f"\nSequential ({args.count} commands)")
+        start = perf_counter()
+        rtts = await run_sequential(reader, writer, frames, commands, args.count, args.timeout)
+        elapsed = perf_counter() - start
+        print_latency(rtts)
+        print(f"  rate    : {len(rtts) / elapsed:8.1f} cmd/s")
+
+        if args.window > 0:
+            print(f"\nWindowed ({args.window} in flight, {args.duration:.0f} s)")
+            frames.bytes = 0
+            rtts, elapsed = await run_windowed(reader, writer, frames, commands,
+                                               args.window, args.duration, args.timeout)
+            print_latency(rtts)
+            print(f"  rate    : {len(rtts) / elapsed:8.1f} cmd/s")
+            print(f"  rx      : {frames.bytes / elapsed:8.0f} B/s")
+
+        if frames.events:
+            print(f"\n  async events seen: {frames.events}")
+    except asyncio.TimeoutError:
+        print(f"\n[ERROR] No reply within {args.timeout} s "
+              "(RX buffer overflow on the firmware side drops commands)")
+        sys.exit(1)
+    finally:
+        writer.close()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,157 @@
+"""Camera strobe position logger.
+
+Turns on the firmware's strobe capture ('strobe on') and writes every
+latched sample to a CSV file: frame sequence number, firmware time of the
+strobe edge (us) and the position of each axis at that edge, in steps and
+units. The firmware timestamps the edge with Timer4 input capture on pin
+49, so the positions belong to the moment the camera fired, not to when
+the sample was read. Stops on Ctrl-C or after --frames samples and sends
+'strobe off'.
+
+A gap in the sequence numbers is a frame the firmware had no room for.
+
+    python xyzStrobeLog.py frames.csv
+    python xyzStrobeLog.py --falling --frames 200 frames.csv
+"""
+
+import argparse
+import asyncio
+import csv
+import json
+import sys
+from pathlib import Path
+
+try:
+    import tomllib
+except ImportError:
+    try:
+        import tomli as tomllib
+    except ImportError:
+        tomllib = None
+
+REPO_ROOT   = Path(__file__).parent.parent.parent
+CONFIG_PATH = REPO_ROOT / "config.toml"
+ETX         = b"\x03"
+
+
+def load_network():
+    if tomllib is None or not CONFIG_PATH.exists():
+        return "127.0.0.1", 5000
+    with open(CONFIG_PATH, "rb") as f:
+        net = tomllib.load(f).get("network", {})
+    return net.get("host", "127.0.0.1"), net.get("port", 5000)
+
+
+class Link:
+    """Commands and replies over the server; '^' events are queued aside."""
+
+    def __init__(self, reader, writer, timeout):
+        self.reader  = reader
+        self.writer  = writer
+        self.timeout = timeout
+        self.events  = asyncio.Queue()
+
+    async def frame(self):
+        frame = await self.reader.readuntil(ETX)
+        return frame[:-1].decode(errors="ignore").strip("\r\n>")
+
+    async def command(self, line):
+        """The reply to `line`, without the firmware's echo of it."""
+        self.writer.write(f"{line}\r".encode())
+        await self.writer.drain()
+
+        async def reply():
+            while True:
+                text = await self.frame()
+                if text.startswith("^"):
+                    self.events.put_nowait(text)
+                elif text.startswith(line):
+                    return text[len(line):].strip()
+        return await asyncio.wait_for(reply(), self.timeout)
+
+    async def json(self, line):
+        text = await self.command(line)
+        return json.loads(text[text.index("{"):])
+
+    async def event(self):
+        if not self.events.empty():
+            return self.events.get_nowait()
+        return await self.frame()
+
+
+def parse_batch(text):
+    """Samples of one '^STROBE [...]' event: (seq, us, [steps...])."""
+    samples = []
+    for line in text.splitlines()[1:]:
+        fields = [int(f) for f in line.split()]
+        if len(fields) >= 3:
+            samples.append((fields[0], fields[1], fields[2:]))
+    return samples
+
+
+async def main():
+    host, port = load_network()
+    parser = argparse.ArgumentParser(description="Log the positions latched on each camera strobe")
+    parser.add_argument("output", help="CSV file to write")
+    parser.add_argument("--host", default=host)
+    parser.add_argument("--port", type=int, default=port)
+    parser.add_argument("--falling", action="store_true",
+                        help="latch on the falling edge (default: rising)")
+    parser.add_argument("--frames", type=int, default=0,
+                        help="stop after this many samples (default: until Ctrl-C)")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds to wait for a reply before giving up")
+    args = parser.parse_args()
+
+    reader, writer = await asyncio.open_connection(args.host, args.port)
+    link = Link(reader, writer, args.timeout)
+    count, missing, last_seq = 0, 0, None
+    try:
+        status = await link.json("status")
+        names  = [k for k in status if k not in ("fsm", "ms")]
+        scale  = [(await link.json(f"axe {n}"))["motor"]["stepsPerUnit"] for n in names]
+
+        reply = await link.command("strobe on falling" if args.falling else "strobe on")
+        if "On" not in reply:
+            raise RuntimeError(reply)
+        link.events = asyncio.Queue()       # samples of an earlier capture
+        print(f"{reply} -> {args.output} (Ctrl-C to stop)")
+
+        with open(args.output, "w", newline="") as f:
+            out = csv.writer(f)
+            out.writerow(["seq", "us"] + [f"{n}_steps" for n in names] + [f"{n}_units" for n in names])
+            while not args.frames or count < args.frames:
+                text = await link.event()
+                if not text.startswith("^STROBE"):
+                    continue
+                for seq, us, steps in parse_batch(text):
+                    if args.frames and count >= args.frames:
+                        break
+                    if last_seq is not None:
+                        missing += (seq - last_seq - 1) & 0xFFFF
+                    last_seq = seq
+                    out.writerow([seq, us] + steps + [f"{s / k:.4f}" for s, k in zip(steps, scale)])
+                    count += 1
+                f.flush()
+    except RuntimeError as e:
+        print(f"[ERROR] {e}")
+        sys.exit(1)
+    except asyncio.TimeoutError:
+        print(f"\n[ERROR] No reply within {args.timeout} s")
+        sys.exit(1)
+    except asyncio.CancelledError:
+        pass
+    finally:
+        try:
+            await link.command("strobe off")
+        except (asyncio.TimeoutError, ConnectionError):
+            pass
+        writer.close()
+        print(f"{count} frames logged, {missing} missing")
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
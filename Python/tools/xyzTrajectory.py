@@ -0,0 +1,288 @@
+"""Trajectory compiler and step-block streamer.
+
+Plans straight-line moves through a list of waypoints on the host and
+streams them to the firmware as timed step blocks ('blk'): every block is
+a duration plus a signed step count per axis, which the firmware spreads
+evenly over the block from a timer interrupt. The firmware only plays the
+blocks back, so the profile does not depend on its main loop timing and
+all axes stay on the same path.
+
+Each segment is a trapezoidal profile along the line, limited by the
+slowest axis (maxSpeed and acceleration from 'axe <axis>'), and stops at
+its waypoint. Blocks are sent up to eight per line and never more than the
+firmware reported free, so none is refused; an empty buffer before the end
+of the stream is reported by the firmware as an underrun.
+
+    python xyzTrajectory.py X=10,Y=5 X=0,Y=0       # absolute units
+    python xyzTrajectory.py -r X=2 Y=2 X=-2 Y=-2    # relative: a square
+    python xyzTrajectory.py --speed 2 --dry-run X=5,Z=1
+"""
+
+import argparse
+import asyncio
+import json
+import math
+import re
+import sys
+from pathlib import Path
+
+try:
+    import tomllib
+except ImportError:
+    try:
+        import tomli as tomllib
+    except ImportError:
+        tomllib = None
+
+REPO_ROOT   = Path(__file__).parent.parent.parent
+CONFIG_PATH = REPO_ROOT / "config.toml"
+ETX         = b"\x03"
+TICK_US     = 50        # BLOCK_TICK_US in StepBlocks.h
+MAX_TICKS   = 32767     # BLOCK_MAX_TICKS
+MAX_LINE    = 170       # MAX_MSG_SIZE in Cmd.h, with some room
+MAX_BATCH   = 8         # MAX_BATCH in Cmd.h
+
+
+def load_network():
+    if tomllib is None or not CONFIG_PATH.exists():
+        return "127.0.0.1", 5000
+    with open(CONFIG_PATH, "rb") as f:
+        net = tomllib.load(f).get("network", {})
+    return net.get("host", "127.0.0.1"), net.get("port", 5000)
+
+
+class FrameReader:
+    """Splits the byte stream into ETX frames, keeping '^' events aside."""
+
+    def __init__(self, reader):
+        self.reader = reader
+        self.events = []
+
+    async def frame(self):
+        frame = await self.reader.readuntil(ETX)
+        return frame[:-1].decode(errors="ignore").strip("\r\n>")
+
+    async def reply(self, line):
+        """The frame that starts with the firmware's echo of `line`, without
+        the echo. Anything else left over from before we connected is dropped."""
+        while True:
+            text = await self.frame()
+            if text.startswith("^"):
+                self.events.append(text)
+            elif text.startswith(line):
+                return text[len(line):].strip()
+
+    async def event(self, prefix):
+        while True:
+            for i, text in enumerate(self.events):
+                if text.startswith(prefix):
+                    return self.events.pop(i)
+            self.events.append(await self.frame())
+
+
+class Link:
+    def __init__(self, reader, writer, timeout):
+        self.frames  = FrameReader(reader)
+        self.writer  = writer
+        self.timeout = timeout
+
+    async def command(self, line):
+        self.writer.write(f"{line}\r".encode())
+        await self.writer.drain()
+        return await asyncio.wait_for(self.frames.reply(line), self.timeout)
+
+    async def json(self, line):
+        text = await self.command(line)
+        return json.loads(text[text.index("{"):])
+
+
+class Axis:
+    def __init__(self, name, cfg, position):
+        motor = cfg["motor"]
+        self.name           = name
+        self.steps_per_unit = motor["stepsPerUnit"]
+        self.max_speed      = motor["maxSpeed"]        # steps/s
+        self.acceleration   = motor["acceleration"]    # steps/s^2
+        self.position       = position                 # steps
+
+
+def parse_waypoint(text, names):
+    point = {}
+    for part in text.split(","):
+        m = re.fullmatch(r"\s*([A-Za-z])\s*=\s*(-?[0-9.]+)\s*", part)
+        if not m or m.group(1).upper() not in names:
+            raise ValueError(f"bad waypoint '{text}' (expected e.g. {names[0]}=1.5,{names[-1]}=-2)")
+        point[m.group(1).upper()] = float(m.group(2))
+    return point
+
+
+def segment_profile(dist, v_max, acc):
+    """Trapezoid along a path of length `dist`: returns (duration, s(t))."""
+    t_acc = v_max / acc
+    if acc * t_acc * t_acc > dist:              # never reaches v_max: triangle
+        t_acc = math.sqrt(dist / acc)
+        v_max = acc * t_acc
+    d_acc  = 0.5 * acc * t_acc * t_acc
+    t_flat = (dist - 2 * d_acc) / v_max
+    total  = 2 * t_acc + t_flat
+
+    def s(t):
+        if t <= 0:
+            return 0.0
+        if t < t_acc:
+            return 0.5 * acc * t * t
+        if t < t_acc + t_flat:
+            return d_acc + v_max * (t - t_acc)
+        if t < total:
+            r = total - t
+            return dist - 0.5 * acc * r * r
+        return dist
+    return total, s
+
+
+def compile_blocks(axes, start, targets, block_s, speed):
+    """Step blocks for straight moves from `start` through `targets`
+    (absolute steps per axis). Positions are rounded from the exact
+    profile, never accumulated, so the rounding error stays below a step."""
+    blocks   = []
+    position = list(start)
+    duration = 0.0
+    for target in targets:
+        delta = [t - p for t, p in zip(target, position)]
+        if not any(delta):
+            continue
+
+        # The path parameter runs in "steps of the longest axis"; each
+        # axis limits the path speed and acceleration by its share of it.
+        length = max(abs(d) for d in delta)
+        v_max  = min(a.max_speed * length / abs(d) for a, d in zip(axes, delta) if d)
+        acc    = min(a.acceleration * length / abs(d) for a, d in zip(axes, delta) if d)
+        if speed:
+            v_max = min([v_max] + [speed * a.steps_per_unit * length / abs(d)
+                                   for a, d in zip(axes, delta) if d])
+        total, s = segment_profile(length, v_max, acc)
+
+        ticks_total = math.ceil(total * 1e6 / TICK_US)
+        ticks_block = min(MAX_TICKS, max(1, round(block_s * 1e6 / TICK_US)))
+        done = 0
+        last = list(position)
+        while done < ticks_total:
+            ticks = min(ticks_block, ticks_total - done)
+            done += ticks
+            frac  = s(done * TICK_US / 1e6) / length
+            now   = [p + round(d * frac) for p, d in zip(position, delta)]
+            steps = [n - l for n, l in zip(now, last)]
+            if any(2 * abs(x) > ticks for x in steps):
+                raise ValueError("axis too fast for the block rate (10 kHz per axis)")
+            blocks.append((ticks * TICK_US, steps))
+            last = now
+        position = last
+        duration += ticks_total * TICK_US / 1e6
+    return blocks, duration
+
+
+async def stream(link, blocks, block_s):
+    """Prefills the firmware buffer, starts it and keeps it topped up."""
+    status = await link.json("blk")
+    if status["state"] != "IDLE" or status["queued"]:
+        await link.command("blk clear")
+        status = await link.json("blk")
+    free    = status["free"]
+    pending = list(blocks)
+    started = False
+
+    while pending or not started:
+        if not pending or (not started and free == 0):
+            reply = await link.command("blk start")
+            if "Playing" not in reply:
+                raise RuntimeError(reply)
+            started = True
+            continue
+
+        if free == 0:
+            await asyncio.sleep(block_s)
+            free = (await link.json("blk"))["free"]
+            continue
+
+        batch, line = 0, ""
+        while batch < min(free, MAX_BATCH) and batch < len(pending):
+            us, steps = pending[batch]
+            cmd = f"blk {us} " + " ".join(str(x) for x in steps)
+            if line and len(line) + 1 + len(cmd) > MAX_LINE:
+                break
+            line  = f"{line};{cmd}" if line else cmd
+            batch += 1
+
+        reply = await link.command(line)
+        accepted = re.findall(r"free=(\d+)", reply)
+        if len(accepted) != batch:
+            await link.command("blk clear")
+            raise RuntimeError(reply.strip())
+        del pending[:batch]
+        free = int(accepted[-1])
+
+    await link.command("blk end")
+
+
+async def main():
+    host, port = load_network()
+    parser = argparse.ArgumentParser(description="Compile moves into step blocks and stream them")
+    parser.add_argument("waypoints", nargs="+", help="e.g. X=10,Y=5 (units)")
+    parser.add_argument("--host", default=host)
+    parser.add_argument("--port", type=int, default=port)
+    parser.add_argument("-r", "--relative", action="store_true",
+                        help="waypoints are offsets from the previous one")
+    parser.add_argument("--speed", type=float, default=0.0,
+                        help="cap on the fastest axis, units/s (default: axis maxSpeed)")
+    parser.add_argument("--block-ms", type=float, default=10.0,
+                        help="block duration (default 10 ms)")
+    parser.add_argument("--dry-run", action="store_true",
+                        help="compile and print the plan, send nothing")
+    parser.add_argument("--timeout", type=float, default=2.0,
+                        help="seconds to wait for a reply before giving up")
+    args = parser.parse_args()
+
+    reader, writer = await asyncio.open_connection(args.host, args.port)
+    link = Link(reader, writer, args.timeout)
+    try:
+        status = await link.json("status")
+        names  = [k for k in status if k not in ("fsm", "ms")]
+        axes   = [Axis(n, await link.json(f"axe {n}"), status[n][0]) for n in names]
+
+        position = [a.position for a in axes]
+        targets  = []
+        for text in args.waypoints:
+            point = parse_waypoint(text, names)
+            nxt = list(position if not targets else targets[-1])
+            for i, a in enumerate(axes):
+                if a.name in point:
+                    steps = round(point[a.name] * a.steps_per_unit)
+                    nxt[i] = nxt[i] + steps if args.relative else steps
+            targets.append(nxt)
+
+        block_s = args.block_ms / 1000.0
+        blocks, duration = compile_blocks(axes, position, targets, block_s, args.speed)
+        print(f"{len(targets)} waypoints -> {len(blocks)} blocks, {duration:.2f} s")
+        if args.dry_run or not blocks:
+            return
+
+        await stream(link, blocks, block_s)
+        event = await asyncio.wait_for(link.frames.event("^BLK"), duration + args.timeout)
+        print(event)
+        if "done" not in event:
+            sys.exit(1)
+    except (RuntimeError, ValueError) as e:
+        print(f"[ERROR] {e}")
+        sys.exit(1)
+    except asyncio.TimeoutError:
+        print(f"\n[ERROR] No reply within {args.timeout} s")
+        sys.exit(1)
+    finally:
+        writer.close()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass